@@ -13,6 +13,9 @@ set SDL3_BUILD_DIR=%SDL3_DIR%\build
 set SDL3_INCLUDE_DIR=%SDL3_DIR%\include
 set SDL3_LIB_DIR=%SDL3_BUILD_DIR%
 
+:: Set HANDMADE_PROFILE=1 to compile in the TIMED_BLOCK instrumentation
+if not defined HANDMADE_PROFILE set HANDMADE_PROFILE=0
+
 
 :: Create build directory if it doesn't exist
 if not exist "%BUILD_DIR%" mkdir "%BUILD_DIR%"
@@ -53,11 +56,13 @@ if not exist "%SDL3_LIB_DIR%\RelWithDebInfo\SDL3.lib" (
     echo SDL3 built successfully
 )
 
-:: Compile the application
-echo Compiling application...
-
-clang++ -std=c++23 ^
+:: Flags shared by the game library and the platform executable.
+:: -ffp-contract=off stops multiplies and adds being fused into FMAs, which
+:: round differently and exist on some targets but not others, so a recording
+:: replays to the same state on every machine.
+set CXXFLAGS=-std=c++23 ^
     -g ^
+    -ffp-contract=off ^
     -Wall ^
     -Wextra ^
     -Wpedantic ^
@@ -66,8 +71,60 @@ clang++ -std=c++23 ^
     -Wno-nested-anon-types ^
     -Wno-language-extension-token ^
     -Wno-keyword-macro ^
+    -DHANDMADE_PROFILE=%HANDMADE_PROFILE% ^
     -I"%SDL3_INCLUDE_DIR%" ^
-    -L"%SDL3_LIB_DIR%\RelWithDebInfo" ^
+    -L"%SDL3_LIB_DIR%\RelWithDebInfo"
+
+:: Compile the game library. The running game reloads it once it changes and
+:: lock.tmp is gone; the PDB gets a fresh name because a debugger attached to
+:: the running game keeps the previous one locked.
+echo Compiling game library...
+
+echo WAITING FOR PDB > "%BUILD_DIR%\lock.tmp"
+del "%BUILD_DIR%\game_*.pdb" > NUL 2> NUL
+
+clang++ %CXXFLAGS% ^
+    -shared ^
+    -o "%BUILD_DIR%\game.dll" ^
+    "%SRC_DIR%\game.cpp" ^
+    -Wl,/PDB:"%BUILD_DIR%\game_%RANDOM%.pdb" ^
+    -lSDL3 ^
+    -MD
+
+if errorlevel 1 (
+    del "%BUILD_DIR%\lock.tmp"
+    echo Game library compilation failed
+    exit /b 1
+)
+
+del "%BUILD_DIR%\lock.tmp"
+
+:: Compile the asset packer, which bakes loose assets into assets.hpak
+echo Compiling asset packer...
+
+clang++ %CXXFLAGS% ^
+    -o "%BUILD_DIR%\asset_packer.exe" ^
+    "%SRC_DIR%\asset_packer.cpp" ^
+    -Wl,/SUBSYSTEM:CONSOLE ^
+    -lSDL3 ^
+    -MD
+
+if errorlevel 1 (
+    echo Asset packer compilation failed
+    exit /b 1
+)
+
+:: A running main.exe can't be overwritten, and it picks up game.dll by itself
+tasklist /FI "IMAGENAME eq main.exe" 2> NUL | find /I "main.exe" > NUL
+if not errorlevel 1 (
+    echo main.exe is running, rebuilt the game library only
+    exit /b 0
+)
+
+:: Compile the platform executable
+echo Compiling application...
+
+clang++ %CXXFLAGS% ^
     -o "%BUILD_DIR%\main.exe" ^
     "%SRC_DIR%\main.cpp" ^
     -Wl,/SUBSYSTEM:WINDOWS ^
@@ -90,5 +147,7 @@ if not exist "%BUILD_DIR%\SDL3.dll" (
 
 echo Build completed successfully!
 echo Executable: %BUILD_DIR%\main.exe
+echo Game library: %BUILD_DIR%\game.dll
+echo Asset packer: %BUILD_DIR%\asset_packer.exe
 
 endlocal
@@ -0,0 +1,182 @@
+#pragma once
+
+#include "core.h"
+#include "mapped_file.h"
+#include "rasterizer.h"
+
+// Asset packs, written offline by asset_packer and read at runtime. A pack is
+// one file: a header, then an index of every asset sorted by id, then the
+// asset data, each asset starting on a 64-byte boundary.
+//
+// Bitmaps are prebaked as premultiplied BGRA rows with no padding, the same
+// byte order as the BGRX32 streaming texture with alpha in the spare byte,
+// so a loaded bitmap points straight into the pack with no decode or
+// swizzle. The pack is mapped rather than read: opening one touches only the
+// header and index, and pixels are paged in the first time they are drawn.
+//
+// Ids are the FNV-1a hash of the asset's name. The packer refuses two names
+// that hash alike, so a lookup is a binary search over the ids alone.
+
+constexpr u32 ASSET_PACK_MAGIC = 0x4B415048; // "HPAK"
+constexpr u32 ASSET_PACK_VERSION = 1;
+constexpr u64 ASSET_PACK_ALIGNMENT = 64;
+
+enum AssetType : u32 {
+    AssetTypeRaw,
+    AssetTypeBitmap,
+};
+
+enum AssetFlags : u32 {
+    AssetOpaque = BIT(0),
+};
+
+struct AssetPackHeader {
+    u32 magic;
+    u32 version;
+    u32 asset_count;
+    u32 index_offset;
+    u64 file_size;
+    u64 reserved;
+};
+
+struct AssetPackEntry {
+    u64 id;
+    u64 offset;
+    u64 size;
+    u32 type;
+    u32 flags;
+    // Bitmaps only; rows are width * 4 bytes apart.
+    i32 width;
+    i32 height;
+};
+
+static_assert(sizeof(AssetPackHeader) == 32);
+static_assert(sizeof(AssetPackEntry) == 40);
+
+struct AssetPack {
+    MappedFile file;
+    const AssetPackEntry* entries;
+    u32 asset_count;
+};
+
+constexpr fn asset_id(const char* name) -> u64 {
+    u64 hash = 0xCBF29CE484222325ull;
+    for (; *name; ++name) {
+        hash = (hash ^ (u8)*name) * 0x100000001B3ull;
+    }
+    return hash;
+}
+
+// Maps the pack and checks that the index and every asset lie inside it. A
+// pack that fails the checks is unmapped again.
+fn open_asset_pack(const char* filename, FixedBufferAllocator* fallback)
+    -> std::expected<AssetPack, FileError> {
+    let mapped = map_entire_file(filename, fallback);
+    if (!mapped) {
+        return std::unexpected(mapped.error());
+    }
+
+    AssetPack pack = {};
+    pack.file = *mapped;
+
+    let fail = [&](const char* reason) {
+        SDL_Log("Asset pack %s is invalid: %s", filename, reason);
+        unmap_file(&pack.file);
+        return std::unexpected(InvalidFormat);
+    };
+
+    File file = pack.file.file;
+    if (file.size < sizeof(AssetPackHeader)) {
+        return fail("too small");
+    }
+
+    AssetPackHeader* header = (AssetPackHeader*)file.data;
+    if (header->magic != ASSET_PACK_MAGIC) {
+        return fail("bad magic");
+    }
+    if (header->version != ASSET_PACK_VERSION) {
+        return fail("unsupported version");
+    }
+    if (header->file_size != file.size) {
+        return fail("truncated");
+    }
+
+    u64 index_size = (u64)header->asset_count * sizeof(AssetPackEntry);
+    if (header->index_offset % alignof(AssetPackEntry) != 0 ||
+        header->index_offset > file.size ||
+        index_size > file.size - header->index_offset) {
+        return fail("index out of bounds");
+    }
+
+    pack.entries = (AssetPackEntry*)(file.data + header->index_offset);
+    pack.asset_count = header->asset_count;
+
+    for (u32 i = 0; i < pack.asset_count; ++i) {
+        const AssetPackEntry* entry = &pack.entries[i];
+        if (i > 0 && entry->id <= pack.entries[i - 1].id) {
+            return fail("index not sorted");
+        }
+        if (entry->offset > file.size ||
+            entry->size > file.size - entry->offset) {
+            return fail("asset out of bounds");
+        }
+        if (entry->type == AssetTypeBitmap &&
+            (entry->width < 0 || entry->height < 0 ||
+             (u64)entry->width * entry->height * sizeof(u32) != entry->size)) {
+            return fail("bitmap size mismatch");
+        }
+    }
+
+    // The index is all that's read up front; asset data is touched on use.
+    advise_mapped_file(&pack.file, FileAdviceRandom);
+
+    return pack;
+}
+
+fn close_asset_pack(AssetPack* pack) -> void {
+    unmap_file(&pack->file);
+    *pack = {};
+}
+
+// Null when the pack has no asset with that id.
+fn find_asset(AssetPack* pack, u64 id) -> const AssetPackEntry* {
+    u32 low = 0;
+    u32 high = pack->asset_count;
+    while (low < high) {
+        u32 middle = low + (high - low) / 2;
+        if (pack->entries[middle].id < id) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    if (low < pack->asset_count && pack->entries[low].id == id) {
+        return &pack->entries[low];
+    }
+    return nullptr;
+}
+
+fn get_asset_data(AssetPack* pack, const AssetPackEntry* entry) -> File {
+    return File{
+        .data = pack->file.file.data + entry->offset,
+        .size = entry->size,
+    };
+}
+
+// A bitmap pointing into the pack, or an empty one when the id is missing or
+// isn't a bitmap.
+fn get_asset_bitmap(AssetPack* pack, u64 id) -> Bitmap {
+    const AssetPackEntry* entry = find_asset(pack, id);
+    if (!entry || entry->type != AssetTypeBitmap) {
+        return Bitmap{};
+    }
+
+    return Bitmap{
+        .pixels = (u32*)(pack->file.file.data + entry->offset),
+        .width = entry->width,
+        .height = entry->height,
+        .pitch = entry->width * (i32)sizeof(u32),
+        .is_opaque = (entry->flags & AssetOpaque) != 0,
+    };
+}
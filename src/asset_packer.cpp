@@ -0,0 +1,205 @@
+#include "asset_pack.h"
+#include "async_writer.h"
+#include "core.h"
+#include "rasterizer.h"
+
+// Offline tool that bakes loose asset files into one asset pack.
+//
+// Usage: asset_packer output.hpak [name=]path ...
+//
+// An asset's name defaults to its file name without the extension. .bmp files
+// are converted to premultiplied BGRA bitmaps; anything else is stored as is.
+
+constexpr usize PACKER_ARENA_SIZE = GB(4);
+
+struct PackInput {
+    const char* name;
+    const char* path;
+    u64 id;
+
+    AssetPackEntry entry;
+    const u8* data;
+};
+
+static fn compare_pack_inputs(const void* a, const void* b) -> int {
+    u64 id_a = ((const PackInput*)a)->id;
+    u64 id_b = ((const PackInput*)b)->id;
+    return id_a < id_b ? -1 : id_a > id_b ? 1 : 0;
+}
+
+// Splits "name=path", or derives the name from the path's file name.
+static fn parse_pack_input(
+    FixedBufferAllocator* arena,
+    const char* arg,
+    PackInput* input
+) -> bool {
+    const char* equals = SDL_strchr(arg, '=');
+    const char* name_start = arg;
+    usize name_length;
+
+    if (equals) {
+        name_length = equals - arg;
+        input->path = equals + 1;
+    } else {
+        input->path = arg;
+        const char* slash = SDL_strrchr(arg, '/');
+        const char* backslash = SDL_strrchr(arg, '\\');
+        if (backslash > slash) {
+            slash = backslash;
+        }
+        name_start = slash ? slash + 1 : arg;
+
+        const char* dot = SDL_strrchr(name_start, '.');
+        name_length = dot ? (usize)(dot - name_start) : SDL_strlen(name_start);
+    }
+
+    if (name_length == 0 || !*input->path) {
+        SDL_Log("Bad asset argument %s", arg);
+        return false;
+    }
+
+    char* name = arena->alloc<char>(name_length + 1);
+    if (!name) {
+        return false;
+    }
+    memcpy(name, name_start, name_length);
+    name[name_length] = '\0';
+
+    input->name = name;
+    input->id = asset_id(name);
+    return true;
+}
+
+static fn has_bmp_extension(const char* path) -> bool {
+    const char* dot = SDL_strrchr(path, '.');
+    return dot && SDL_strcasecmp(dot, ".bmp") == 0;
+}
+
+static fn load_pack_input(FixedBufferAllocator* arena, PackInput* input)
+    -> bool {
+    input->entry.id = input->id;
+
+    if (has_bmp_extension(input->path)) {
+        let bitmap = load_bitmap(input->path, arena);
+        if (!bitmap) {
+            return false;
+        }
+
+        input->data = (const u8*)bitmap->pixels;
+        input->entry.type = AssetTypeBitmap;
+        input->entry.flags = bitmap->is_opaque ? (u32)AssetOpaque : 0;
+        input->entry.width = bitmap->width;
+        input->entry.height = bitmap->height;
+        input->entry.size = (u64)bitmap->pitch * bitmap->height;
+        return true;
+    }
+
+    let file = read_entire_file(input->path, arena);
+    if (!file) {
+        return false;
+    }
+
+    input->data = file->data;
+    input->entry.type = AssetTypeRaw;
+    input->entry.size = file->size;
+    return true;
+}
+
+static fn align_pack_offset(u64 offset) -> u64 {
+    return (offset + ASSET_PACK_ALIGNMENT - 1) & ~(ASSET_PACK_ALIGNMENT - 1);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        SDL_Log("Usage: asset_packer output.hpak [name=]path ...");
+        return -1;
+    }
+
+    let arena = FixedBufferAllocator::reserve(PACKER_ARENA_SIZE);
+    if (!arena.memory) {
+        return -1;
+    }
+    defer { arena.destroy(); };
+
+    const char* output_path = argv[1];
+    u32 input_count = (u32)(argc - 2);
+    PackInput* inputs = arena.alloc<PackInput>(input_count);
+    if (!inputs) {
+        return -1;
+    }
+    memset(inputs, 0, sizeof(PackInput) * input_count);
+
+    for (u32 i = 0; i < input_count; ++i) {
+        if (!parse_pack_input(&arena, argv[i + 2], &inputs[i])) {
+            return -1;
+        }
+    }
+
+    // Sorted by id, so the index can be written in order and lookups can
+    // binary search. Equal neighbours are duplicate names or hash collisions.
+    SDL_qsort(inputs, input_count, sizeof(PackInput), compare_pack_inputs);
+    for (u32 i = 1; i < input_count; ++i) {
+        if (inputs[i].id == inputs[i - 1].id) {
+            SDL_Log(
+                "Assets %s (%s) and %s (%s) have the same id",
+                inputs[i - 1].name,
+                inputs[i - 1].path,
+                inputs[i].name,
+                inputs[i].path
+            );
+            return -1;
+        }
+    }
+
+    u64 index_offset = sizeof(AssetPackHeader);
+    u64 offset = index_offset + (u64)input_count * sizeof(AssetPackEntry);
+    for (u32 i = 0; i < input_count; ++i) {
+        if (!load_pack_input(&arena, &inputs[i])) {
+            SDL_Log("Failed to pack %s", inputs[i].path);
+            return -1;
+        }
+
+        offset = align_pack_offset(offset);
+        inputs[i].entry.offset = offset;
+        offset += inputs[i].entry.size;
+    }
+
+    u64 file_size = offset;
+    u8* output = (u8*)arena.alloc_bytes(file_size, ASSET_PACK_ALIGNMENT);
+    if (!output) {
+        return -1;
+    }
+    memset(output, 0, file_size);
+
+    AssetPackHeader* header = (AssetPackHeader*)output;
+    *header = AssetPackHeader{
+        .magic = ASSET_PACK_MAGIC,
+        .version = ASSET_PACK_VERSION,
+        .asset_count = input_count,
+        .index_offset = (u32)index_offset,
+        .file_size = file_size,
+        .reserved = 0,
+    };
+
+    AssetPackEntry* index = (AssetPackEntry*)(output + index_offset);
+    for (u32 i = 0; i < input_count; ++i) {
+        index[i] = inputs[i].entry;
+        memcpy(
+            output + inputs[i].entry.offset,
+            inputs[i].data,
+            inputs[i].entry.size
+        );
+    }
+
+    if (!write_file_atomically(output_path, output, file_size)) {
+        return -1;
+    }
+
+    SDL_Log(
+        "Packed %u assets into %s (%llu bytes)",
+        input_count,
+        output_path,
+        (unsigned long long)file_size
+    );
+    return 0;
+}
@@ -0,0 +1,189 @@
+#pragma once
+
+#include "core.h"
+#include "work_queue.h"
+
+// Background file loading on a small pool of I/O threads. The caller reserves
+// the destination in one of its arenas up front, the I/O thread reads the file
+// straight into it in chunks, and the caller collects finished loads with
+// poll_async_loads(), which never blocks. Requests and polls must come from
+// the thread that owns the loader.
+//
+// Each slot's state has one owner at a time: the owning thread moves it from
+// free to queued and from done/failed back to free, the I/O thread moves it
+// from queued through reading to done/failed.
+
+constexpr u32 MAX_ASYNC_LOADS = 64;
+constexpr usize ASYNC_LOAD_CHUNK_SIZE = MB(1);
+constexpr i32 ASYNC_LOADER_THREADS = 2;
+
+enum AsyncLoadState : i32 {
+    AsyncLoadFree,
+    AsyncLoadQueued,
+    AsyncLoadReading,
+    AsyncLoadDone,
+    AsyncLoadFailed,
+};
+
+struct AsyncLoader;
+
+struct AsyncLoad {
+    SDL_AtomicInt state;
+    AsyncLoader* loader;
+
+    char filename[256];
+    u8* destination;
+    usize size;
+    u64 user_data;
+
+    u64 queued_ns;
+    u64 finished_ns;
+};
+
+struct AsyncLoadCompletion {
+    u64 user_data;
+    File file;
+    bool succeeded;
+    u64 elapsed_ns;
+};
+
+struct AsyncLoader {
+    WorkQueue queue;
+    SDL_AtomicInt cancelled;
+    AsyncLoad loads[MAX_ASYNC_LOADS];
+};
+
+static fn async_load_work(
+    [[maybe_unused]] WorkQueue* queue,
+    [[maybe_unused]] FixedBufferAllocator* scratch,
+    void* data
+) -> void {
+    AsyncLoad* load = (AsyncLoad*)data;
+    SDL_SetAtomicInt(&load->state, AsyncLoadReading);
+
+    AsyncLoadState result = AsyncLoadFailed;
+    defer {
+        load->finished_ns = SDL_GetTicksNS();
+        SDL_MemoryBarrierRelease();
+        SDL_SetAtomicInt(&load->state, result);
+    };
+
+    SDL_IOStream* file = SDL_IOFromFile(load->filename, "rb");
+    if (!file) {
+        SDL_Log("Failed to open file %s: %s", load->filename, SDL_GetError());
+        return;
+    }
+    defer { SDL_CloseIO(file); };
+
+    // Chunked so a shutdown never waits on more than one chunk.
+    for (usize offset = 0; offset < load->size;
+         offset += ASYNC_LOAD_CHUNK_SIZE) {
+        if (SDL_GetAtomicInt(&load->loader->cancelled))
+            return;
+
+        usize count = SDL_min(ASYNC_LOAD_CHUNK_SIZE, load->size - offset);
+        if (SDL_ReadIO(file, load->destination + offset, count) != count) {
+            SDL_Log("Failed to read entire file %s", load->filename);
+            return;
+        }
+    }
+
+    result = AsyncLoadDone;
+}
+
+fn init_async_loader(AsyncLoader* loader) -> bool {
+    SDL_SetAtomicInt(&loader->cancelled, 0);
+
+    for (u32 i = 0; i < MAX_ASYNC_LOADS; ++i) {
+        loader->loads[i] = {};
+        loader->loads[i].loader = loader;
+    }
+
+    return init_work_queue(&loader->queue, ASYNC_LOADER_THREADS, "io");
+}
+
+// Cancels whatever is still queued or reading and waits for the I/O threads,
+// so the arenas loads were reading into can be released afterwards.
+fn shutdown_async_loader(AsyncLoader* loader) -> void {
+    SDL_SetAtomicInt(&loader->cancelled, 1);
+    shutdown_work_queue(&loader->queue);
+}
+
+// Reserves the whole file in arena and queues the read. Returns false without
+// touching arena when every slot is busy, the name doesn't fit in one, or the
+// file can't be found.
+fn begin_async_load(
+    AsyncLoader* loader,
+    const char* filename,
+    FixedBufferAllocator* arena,
+    u64 user_data
+) -> bool {
+    if (SDL_strlen(filename) >= sizeof(loader->loads[0].filename)) {
+        SDL_Log("Path too long to load: %s", filename);
+        return false;
+    }
+
+    AsyncLoad* load = nullptr;
+    for (u32 i = 0; i < MAX_ASYNC_LOADS; ++i) {
+        if (SDL_GetAtomicInt(&loader->loads[i].state) == AsyncLoadFree) {
+            load = &loader->loads[i];
+            break;
+        }
+    }
+
+    if (!load) {
+        SDL_Log("Too many loads in flight, dropping %s", filename);
+        return false;
+    }
+
+    SDL_PathInfo info;
+    if (!SDL_GetPathInfo(filename, &info)) {
+        SDL_Log("Failed to stat file %s: %s", filename, SDL_GetError());
+        return false;
+    }
+
+    u8* destination = (u8*)arena->alloc_bytes(info.size, 64);
+    if (!destination && info.size) {
+        return false;
+    }
+
+    SDL_strlcpy(load->filename, filename, sizeof(load->filename));
+    load->destination = destination;
+    load->size = info.size;
+    load->user_data = user_data;
+    load->queued_ns = SDL_GetTicksNS();
+    load->finished_ns = 0;
+
+    SDL_SetAtomicInt(&load->state, AsyncLoadQueued);
+    add_work_entry(&loader->queue, async_load_work, load);
+
+    return true;
+}
+
+// Copies out up to max_count finished loads and frees their slots.
+fn poll_async_loads(
+    AsyncLoader* loader,
+    AsyncLoadCompletion* completions,
+    u32 max_count
+) -> u32 {
+    u32 count = 0;
+
+    for (u32 i = 0; i < MAX_ASYNC_LOADS && count < max_count; ++i) {
+        AsyncLoad* load = &loader->loads[i];
+        i32 state = SDL_GetAtomicInt(&load->state);
+        if (state != AsyncLoadDone && state != AsyncLoadFailed)
+            continue;
+
+        SDL_MemoryBarrierAcquire();
+        completions[count++] = AsyncLoadCompletion{
+            .user_data = load->user_data,
+            .file = {.data = load->destination, .size = load->size},
+            .succeeded = state == AsyncLoadDone,
+            .elapsed_ns = load->finished_ns - load->queued_ns,
+        };
+
+        SDL_SetAtomicInt(&load->state, AsyncLoadFree);
+    }
+
+    return count;
+}
@@ -0,0 +1,319 @@
+#pragma once
+
+#include "core.h"
+#include "work_queue.h"
+
+// Background file writing on a single I/O thread, so saves and replay dumps
+// never stall a frame. Every write goes to a temporary file next to the
+// target, is synced to disk, and only then renamed over the target, so a
+// crash leaves either the old file or the new one, never half of either.
+// One thread keeps the writes in the order they were queued.
+//
+// Small writes are copied when queued and the caller can reuse its buffer
+// straight away; larger ones are written from the caller's buffer, which has
+// to stay alive until the write is polled as finished. Queuing a write to a
+// file that still has one waiting replaces the waiting one, so a game that
+// saves every frame only pays for the saves the disk can keep up with.
+//
+// Slot states follow the loader's rules: the owning thread moves a slot from
+// free to queued, from queued to superseded, and from finished back to free;
+// the I/O thread does everything else.
+
+#if defined(SDL_PLATFORM_WINDOWS)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#elif defined(SDL_PLATFORM_UNIX) || defined(SDL_PLATFORM_APPLE)
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+constexpr u32 MAX_ASYNC_WRITES = 32;
+constexpr usize ASYNC_WRITE_CHUNK_SIZE = MB(1);
+constexpr usize ASYNC_WRITE_COPY_SIZE = KB(64);
+
+enum AsyncWriteState : i32 {
+    AsyncWriteFree,
+    AsyncWriteQueued,
+    AsyncWriteSuperseded,
+    AsyncWriteWriting,
+    AsyncWriteDone,
+    AsyncWriteFailed,
+    AsyncWriteCoalesced,
+};
+
+struct AsyncWrite {
+    SDL_AtomicInt state;
+
+    char filename[256];
+    const u8* data;
+    usize size;
+    u64 user_data;
+
+    u64 queued_ns;
+    u64 finished_ns;
+
+    alignas(64) u8 copy[ASYNC_WRITE_COPY_SIZE];
+};
+
+struct AsyncWriteCompletion {
+    u64 user_data;
+    usize size;
+    bool succeeded;
+    // Replaced by a later write to the same file before it reached the disk.
+    bool coalesced;
+    u64 elapsed_ns;
+};
+
+struct AsyncWriter {
+    WorkQueue queue;
+    AsyncWrite writes[MAX_ASYNC_WRITES];
+};
+
+// Pushes what the OS has buffered for the file out to the disk.
+static fn sync_io_stream(SDL_IOStream* file) -> bool {
+    if (!SDL_FlushIO(file)) {
+        return false;
+    }
+
+    SDL_PropertiesID props = SDL_GetIOProperties(file);
+#if defined(SDL_PLATFORM_WINDOWS)
+    HANDLE handle = (HANDLE)SDL_GetPointerProperty(
+        props,
+        SDL_PROP_IOSTREAM_WINDOWS_HANDLE_POINTER,
+        nullptr
+    );
+    return handle && FlushFileBuffers(handle);
+#elif defined(SDL_PLATFORM_UNIX) || defined(SDL_PLATFORM_APPLE)
+    i64 fd = SDL_GetNumberProperty(
+        props,
+        SDL_PROP_IOSTREAM_FILE_DESCRIPTOR_NUMBER,
+        -1
+    );
+    return fd >= 0 && fsync((int)fd) == 0;
+#else
+    (void)props;
+    return true;
+#endif
+}
+
+// A rename only survives a crash once the directory holding it is synced too.
+// Windows has no equivalent; MoveFileEx is as durable as it gets there.
+static fn sync_parent_directory([[maybe_unused]] const char* filename)
+    -> bool {
+#if defined(SDL_PLATFORM_UNIX) || defined(SDL_PLATFORM_APPLE)
+    char directory[1024];
+    if (SDL_strlcpy(directory, filename, sizeof(directory)) >=
+        sizeof(directory)) {
+        SDL_Log("Path too long to sync: %s", filename);
+        return false;
+    }
+
+    char* slash = SDL_strrchr(directory, '/');
+    if (slash) {
+        slash[slash == directory ? 1 : 0] = '\0';
+    } else {
+        SDL_strlcpy(directory, ".", sizeof(directory));
+    }
+
+    int fd = open(directory, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        SDL_Log("Failed to open directory %s: %s", directory, strerror(errno));
+        return false;
+    }
+
+    // Some filesystems can't sync a directory at all; there's nothing more to
+    // be had there, so that counts as done.
+    bool synced = fsync(fd) == 0 || errno == EINVAL || errno == EROFS;
+    if (!synced) {
+        SDL_Log("Failed to sync directory %s: %s", directory, strerror(errno));
+    }
+    close(fd);
+
+    return synced;
+#else
+    return true;
+#endif
+}
+
+// The blocking half of the writer, for callers that have to know the file is
+// on disk before they carry on. Writes and syncs filename.tmp, then renames it
+// over filename.
+[[maybe_unused]]
+fn write_file_atomically(const char* filename, const void* data, usize size)
+    -> bool {
+    char temp_filename[1024];
+    int temp_length =
+        SDL_snprintf(temp_filename, sizeof(temp_filename), "%s.tmp", filename);
+    if (temp_length < 0 || temp_length >= (int)sizeof(temp_filename)) {
+        SDL_Log("Path too long to write: %s", filename);
+        return false;
+    }
+
+    SDL_IOStream* file = SDL_IOFromFile(temp_filename, "wb");
+    if (!file) {
+        SDL_Log("Failed to create file %s: %s", temp_filename, SDL_GetError());
+        return false;
+    }
+
+    bool written = true;
+    for (usize offset = 0; offset < size && written;
+         offset += ASYNC_WRITE_CHUNK_SIZE) {
+        usize count = SDL_min(ASYNC_WRITE_CHUNK_SIZE, size - offset);
+        written = SDL_WriteIO(file, (const u8*)data + offset, count) == count;
+    }
+
+    if (!written) {
+        SDL_Log("Failed to write complete data to file");
+    } else if (!sync_io_stream(file)) {
+        SDL_Log("Failed to sync file %s", temp_filename);
+        written = false;
+    }
+
+    if (!SDL_CloseIO(file)) {
+        written = false;
+    }
+
+    if (!written || !SDL_RenamePath(temp_filename, filename)) {
+        if (written) {
+            SDL_Log("Failed to rename %s: %s", temp_filename, SDL_GetError());
+        }
+        SDL_RemovePath(temp_filename);
+        return false;
+    }
+
+    return sync_parent_directory(filename);
+}
+
+static fn async_write_work(
+    [[maybe_unused]] WorkQueue* queue,
+    [[maybe_unused]] FixedBufferAllocator* scratch,
+    void* data
+) -> void {
+    AsyncWrite* write = (AsyncWrite*)data;
+
+    AsyncWriteState result = AsyncWriteCoalesced;
+    if (SDL_CompareAndSwapAtomicInt(
+            &write->state,
+            AsyncWriteQueued,
+            AsyncWriteWriting
+        )) {
+        bool written =
+            write_file_atomically(write->filename, write->data, write->size);
+        result = written ? AsyncWriteDone : AsyncWriteFailed;
+    }
+
+    write->finished_ns = SDL_GetTicksNS();
+    SDL_MemoryBarrierRelease();
+    SDL_SetAtomicInt(&write->state, result);
+}
+
+fn init_async_writer(AsyncWriter* writer) -> bool {
+    for (u32 i = 0; i < MAX_ASYNC_WRITES; ++i) {
+        SDL_SetAtomicInt(&writer->writes[i].state, AsyncWriteFree);
+    }
+
+    return init_work_queue(&writer->queue, 1, "io_write");
+}
+
+// Unlike loads, writes are finished rather than cancelled: the owning thread
+// helps drain whatever is still queued before the thread is stopped.
+fn shutdown_async_writer(AsyncWriter* writer) -> void {
+    if (writer->queue.semaphore) {
+        complete_all_work(&writer->queue);
+    }
+    shutdown_work_queue(&writer->queue);
+}
+
+// Queues a write of size bytes from data to filename. Returns false when
+// every slot is busy or filename doesn't fit in one, in which case nothing
+// was written.
+fn begin_async_write(
+    AsyncWriter* writer,
+    const char* filename,
+    const void* data,
+    usize size,
+    u64 user_data
+) -> bool {
+    // Checked before anything else, so a name that would be cut short can't
+    // supersede the queued writes of some other file.
+    if (SDL_strlen(filename) >= sizeof(writer->writes[0].filename)) {
+        SDL_Log("Path too long to write: %s", filename);
+        return false;
+    }
+
+    AsyncWrite* write = nullptr;
+    for (u32 i = 0; i < MAX_ASYNC_WRITES; ++i) {
+        if (SDL_GetAtomicInt(&writer->writes[i].state) == AsyncWriteFree) {
+            write = &writer->writes[i];
+            break;
+        }
+    }
+
+    if (!write) {
+        SDL_Log("Too many writes in flight, dropping %s", filename);
+        return false;
+    }
+
+    for (u32 i = 0; i < MAX_ASYNC_WRITES; ++i) {
+        AsyncWrite* waiting = &writer->writes[i];
+        if (SDL_GetAtomicInt(&waiting->state) == AsyncWriteQueued &&
+            SDL_strcmp(waiting->filename, filename) == 0) {
+            // Loses the race harmlessly if the I/O thread just started it.
+            SDL_CompareAndSwapAtomicInt(
+                &waiting->state,
+                AsyncWriteQueued,
+                AsyncWriteSuperseded
+            );
+        }
+    }
+
+    if (size <= ASYNC_WRITE_COPY_SIZE) {
+        memcpy(write->copy, data, size);
+        data = write->copy;
+    }
+
+    SDL_strlcpy(write->filename, filename, sizeof(write->filename));
+    write->data = (const u8*)data;
+    write->size = size;
+    write->user_data = user_data;
+    write->queued_ns = SDL_GetTicksNS();
+    write->finished_ns = 0;
+
+    SDL_SetAtomicInt(&write->state, AsyncWriteQueued);
+    add_work_entry(&writer->queue, async_write_work, write);
+
+    return true;
+}
+
+// Copies out up to max_count finished writes and frees their slots.
+fn poll_async_writes(
+    AsyncWriter* writer,
+    AsyncWriteCompletion* completions,
+    u32 max_count
+) -> u32 {
+    u32 count = 0;
+
+    for (u32 i = 0; i < MAX_ASYNC_WRITES && count < max_count; ++i) {
+        AsyncWrite* write = &writer->writes[i];
+        i32 state = SDL_GetAtomicInt(&write->state);
+        if (state != AsyncWriteDone && state != AsyncWriteFailed &&
+            state != AsyncWriteCoalesced)
+            continue;
+
+        SDL_MemoryBarrierAcquire();
+        completions[count++] = AsyncWriteCompletion{
+            .user_data = write->user_data,
+            .size = write->size,
+            .succeeded = state == AsyncWriteDone,
+            .coalesced = state == AsyncWriteCoalesced,
+            .elapsed_ns = write->finished_ns - write->queued_ns,
+        };
+
+        SDL_SetAtomicInt(&write->state, AsyncWriteFree);
+    }
+
+    return count;
+}
@@ -6,6 +6,16 @@
 #include <expected>
 #include <utility>
 
+#if defined(SDL_PLATFORM_WINDOWS)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#define HANDMADE_VIRTUAL_MEMORY_WIN32 1
+#elif defined(SDL_PLATFORM_UNIX) || defined(SDL_PLATFORM_APPLE)
+#include <sys/mman.h>
+#define HANDMADE_VIRTUAL_MEMORY_POSIX 1
+#endif
+
 typedef uint8_t u8;
 typedef uint16_t u16;
 typedef uint32_t u32;
@@ -20,16 +30,23 @@ typedef size_t usize;
 
 #define fn auto
 #define let auto
+#if defined(_WIN32)
+#define DLL_EXPORT __declspec(dllexport)
+#else
+#define DLL_EXPORT __attribute__((visibility("default")))
+#endif
+
 #ifdef __cplusplus
-#define export extern "C"
+#define export extern "C" DLL_EXPORT
 #else
-#define export extern
+#define export extern DLL_EXPORT
 #endif
 
 #define BIT(x) 1 << (x)
 #define KB(x) ((usize)1024 * x)
 #define MB(x) ((usize)1024 * KB(x))
 #define GB(x) ((usize)1024 * MB(x))
+#define TB(x) ((usize)1024 * GB(x))
 #define NANOS_TO_SECONDS(ns) ns / 1000000000.0f
 
 template <typename F> struct Defer {
@@ -50,16 +67,103 @@ template <typename F> Defer<F> operator+(defer_dummy, F&& f) {
 
 #define defer auto _defer(__LINE__) = defer_dummy() + [&]()
 
+constexpr usize ARENA_COMMIT_GRANULARITY = KB(64);
+constexpr usize HUGE_PAGE_SIZE = MB(2);
+
+// Reserves address space without backing it with memory. base_address is only
+// a request: if that range is taken, the reservation lands wherever the OS
+// puts it. huge_pages asks for transparent huge pages where there are any;
+// Windows only has large pages that are committed up front, so it's ignored
+// there.
+[[maybe_unused]]
+fn reserve_virtual_memory(
+    usize size,
+    void* base_address,
+    [[maybe_unused]] bool huge_pages
+) -> u8* {
+#if HANDMADE_VIRTUAL_MEMORY_WIN32
+    void* memory = VirtualAlloc(base_address, size, MEM_RESERVE, PAGE_NOACCESS);
+    if (!memory && base_address) {
+        memory = VirtualAlloc(nullptr, size, MEM_RESERVE, PAGE_NOACCESS);
+    }
+
+    return (u8*)memory;
+#elif HANDMADE_VIRTUAL_MEMORY_POSIX
+    void* memory = mmap(
+        base_address,
+        size,
+        PROT_NONE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+        -1,
+        0
+    );
+    if (memory == MAP_FAILED) {
+        return nullptr;
+    }
+
+#if defined(MADV_HUGEPAGE)
+    if (huge_pages) {
+        madvise(memory, size, MADV_HUGEPAGE);
+    }
+#endif
+
+    return (u8*)memory;
+#else
+    (void)base_address;
+    return (u8*)SDL_calloc(1, size);
+#endif
+}
+
+// Backs part of a reservation with memory. Committed pages read as zero and
+// only become resident once they are touched.
+[[maybe_unused]]
+fn commit_virtual_memory(u8* memory, usize size) -> bool {
+#if HANDMADE_VIRTUAL_MEMORY_WIN32
+    return VirtualAlloc(memory, size, MEM_COMMIT, PAGE_READWRITE) != nullptr;
+#elif HANDMADE_VIRTUAL_MEMORY_POSIX
+    return mprotect(memory, size, PROT_READ | PROT_WRITE) == 0;
+#else
+    (void)memory;
+    (void)size;
+    return true;
+#endif
+}
+
+[[maybe_unused]]
+fn release_virtual_memory(u8* memory, [[maybe_unused]] usize size) -> void {
+#if HANDMADE_VIRTUAL_MEMORY_WIN32
+    VirtualFree(memory, 0, MEM_RELEASE);
+#elif HANDMADE_VIRTUAL_MEMORY_POSIX
+    munmap(memory, size);
+#else
+    SDL_free(memory);
+#endif
+}
+
+// Bump allocator over one block of memory. Everything it hands out is freed
+// at once, either by resetting it or by ending a temporary scope. used and
+// high_water are kept in every build; they cost a compare per allocation.
 struct FixedBufferAllocator {
     usize capacity;
     usize used;
     u8* memory;
 
+    usize high_water;
+    i32 temp_count;
+    bool owns_memory;
+
+    // Reserved arenas commit their address space as they grow into it, a
+    // commit_granularity step at a time. Other arenas are committed whole.
+    bool is_reserved;
+    usize committed;
+    usize commit_granularity;
+
     static FixedBufferAllocator create(usize size) {
         FixedBufferAllocator fba = {};
         fba.capacity = size;
         fba.used = 0;
         fba.memory = (u8*)SDL_malloc(size);
+        fba.owns_memory = true;
 
         if (!fba.memory) {
             SDL_Log("Buy more RAM lol!");
@@ -67,32 +171,79 @@ struct FixedBufferAllocator {
         }
 
         memset(fba.memory, 0, size);
+        fba.committed = size;
 
         return fba;
     }
 
-    void destroy() {
-        capacity = 0;
-        used = 0;
-        SDL_free(memory);
+    // Reserves size bytes of address space and commits none of it, so the
+    // arena costs nothing until it's used. A fixed base_address keeps
+    // pointers into the arena valid from one run to the next.
+    static FixedBufferAllocator reserve(
+        usize size,
+        void* base_address = nullptr,
+        bool huge_pages = false
+    ) {
+        FixedBufferAllocator fba = {};
+        usize granularity =
+            huge_pages ? HUGE_PAGE_SIZE : ARENA_COMMIT_GRANULARITY;
+        size = (size + granularity - 1) & ~(granularity - 1);
+
+        fba.memory = reserve_virtual_memory(size, base_address, huge_pages);
+        if (!fba.memory) {
+            SDL_Log("Failed to reserve %zu MB of address space", size / MB(1));
+            SDL_assert(false);
+            return fba;
+        }
+
+        if (base_address && fba.memory != base_address) {
+            SDL_Log(
+                "Arena reserved at %p instead of %p",
+                (void*)fba.memory,
+                base_address
+            );
+        }
+
+        fba.capacity = size;
+        fba.owns_memory = true;
+        fba.is_reserved = true;
+        fba.commit_granularity = granularity;
+
+        return fba;
     }
 
-    template <typename T> fn alloc(usize count = 1) -> T* {
-        usize size = sizeof(T) * count;
+    // A sub-arena carved out of the parent. It lives as long as that
+    // allocation does and is never destroyed on its own.
+    static FixedBufferAllocator create_from(
+        FixedBufferAllocator* parent,
+        usize size,
+        usize alignment = 64
+    ) {
+        FixedBufferAllocator fba = {};
+        fba.memory = (u8*)parent->alloc_bytes(size, alignment);
+        fba.capacity = fba.memory ? size : 0;
+        fba.committed = fba.capacity;
 
-        usize alignment = alignof(T);
-        usize aligned_used = (used + alignment - 1) & ~(alignment - 1);
+        return fba;
+    }
 
-        if (aligned_used + size > capacity) {
-            SDL_Log("How could you fumble your memory this bad?");
-            SDL_assert(false);
-            return nullptr;
+    void destroy() {
+        SDL_assert(temp_count == 0);
+        if (is_reserved) {
+            release_virtual_memory(memory, capacity);
+        } else if (owns_memory) {
+            SDL_free(memory);
         }
+        *this = {};
+    }
 
-        T* result = (T*)(memory + aligned_used);
-        used = aligned_used + size;
+    void reset() {
+        SDL_assert(temp_count == 0);
+        used = 0;
+    }
 
-        return result;
+    template <typename T> fn alloc(usize count = 1) -> T* {
+        return (T*)alloc_bytes(sizeof(T) * count, alignof(T));
     }
 
     template <typename T, typename... Args>
@@ -109,7 +260,8 @@ struct FixedBufferAllocator {
     auto alloc_bytes(usize size, usize alignment = sizeof(void*)) -> void* {
         usize aligned_used = (used + alignment - 1) & ~(alignment - 1);
 
-        if (aligned_used + size > capacity) {
+        if (aligned_used + size > capacity ||
+            (aligned_used + size > committed && !commit(aligned_used + size))) {
             SDL_Log("How could you fumble your memory this bad?");
             SDL_assert(false);
             return nullptr;
@@ -117,9 +269,119 @@ struct FixedBufferAllocator {
 
         void* result = memory + aligned_used;
         used = aligned_used + size;
+        high_water = SDL_max(high_water, used);
 
         return result;
     }
+
+    // Commits whatever lies between what's committed and end.
+    bool commit(usize end) {
+        if (!is_reserved)
+            return false;
+
+        usize new_committed = (end + commit_granularity - 1) &
+                              ~(commit_granularity - 1);
+        new_committed = SDL_min(new_committed, capacity);
+
+        if (!commit_virtual_memory(
+                memory + committed,
+                new_committed - committed
+            )) {
+            return false;
+        }
+
+        committed = new_committed;
+        return true;
+    }
+};
+
+// Everything allocated between begin_temporary_memory and the matching
+// end_temporary_memory is freed by the end call. Scopes nest, and have to be
+// ended in the reverse order they were begun.
+struct TemporaryMemory {
+    FixedBufferAllocator* arena;
+    usize used;
+};
+
+[[maybe_unused]]
+fn begin_temporary_memory(FixedBufferAllocator* arena) -> TemporaryMemory {
+    arena->temp_count += 1;
+    return TemporaryMemory{arena, arena->used};
+}
+
+[[maybe_unused]]
+fn end_temporary_memory(TemporaryMemory temp) -> void {
+    FixedBufferAllocator* arena = temp.arena;
+    SDL_assert(arena->used >= temp.used);
+    SDL_assert(arena->temp_count > 0);
+
+    arena->used = temp.used;
+    arena->temp_count -= 1;
+}
+
+// Catches a scope that was begun and never ended.
+[[maybe_unused]]
+fn check_arena(FixedBufferAllocator* arena) -> void {
+    SDL_assert(arena->temp_count == 0);
+}
+
+// Fixed-size slots of T, at most capacity of them, with freed slots kept on
+// an intrusive free list so allocating and freeing are both O(1). A slot is
+// only carved from the arena the first time the free list comes up empty, so
+// the pool costs nothing beyond the slots actually used. Slots are never
+// returned to the arena. Like the arena itself, the pool is plain data and
+// doesn't hold on to the arena: callers pass it in.
+template <typename T> struct PoolAllocator {
+    union Slot {
+        Slot* next_free;
+        alignas(T) u8 value[sizeof(T)];
+    };
+
+    Slot* first_free;
+    u32 capacity;
+    u32 used;
+    u32 high_water;
+
+    static PoolAllocator create(u32 capacity) {
+        PoolAllocator pool = {};
+        pool.capacity = capacity;
+        return pool;
+    }
+
+    template <typename... Args>
+    fn alloc(FixedBufferAllocator* arena, Args&&... args) -> T* {
+        Slot* slot = first_free;
+        if (slot) {
+            first_free = slot->next_free;
+        } else if (used < capacity) {
+            slot = arena->alloc<Slot>();
+            if (!slot) {
+                return nullptr;
+            }
+        } else {
+            SDL_Log("Pool of %u slots is full", capacity);
+            SDL_assert(false);
+            return nullptr;
+        }
+
+        used += 1;
+        high_water = SDL_max(high_water, used);
+
+        return new (slot->value) T(std::forward<Args>(args)...);
+    }
+
+    void free(T* value) {
+        if (!value)
+            return;
+
+        SDL_assert(used > 0);
+        Slot* slot = (Slot*)value;
+
+        value->~T();
+        slot->next_free = first_free;
+        first_free = slot;
+        used -= 1;
+    }
 };
 
 struct File {
@@ -132,7 +394,9 @@ enum FileError {
     StatReadFailed,
     SizeReadFailed,
     AllocationFailed,
-    ReadFailed
+    ReadFailed,
+    MapFailed,
+    InvalidFormat
 };
 
 [[maybe_unused]]
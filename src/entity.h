@@ -0,0 +1,163 @@
+#pragma once
+
+#include "core.h"
+#include "simd.h"
+
+// Entities stored as structure-of-arrays: each field is its own contiguous
+// array, so a pass that only needs positions and velocities streams through
+// just those, four entities per SIMD lane. Slots are recycled through a free
+// list; a handle carries the generation its slot had when it was created, so
+// handles to destroyed entities stop resolving instead of aliasing whatever
+// reuses the slot.
+//
+// Destroyed slots keep zero velocity, which lets the batch passes run over
+// every slot up to high_index without checking flags.
+
+enum EntityFlags : u32 {
+    EntityAlive = BIT(0),
+};
+
+struct EntityHandle {
+    u32 index;
+    // Zero is never a live generation, so a zeroed handle is always invalid.
+    u32 generation;
+};
+
+constexpr u32 ENTITY_NO_FREE_SLOT = UINT32_MAX;
+
+struct EntityStore {
+    u32 capacity;
+    // Slots at or past high_index have never been handed out.
+    u32 high_index;
+    u32 count;
+    u32 first_free;
+
+    f32* position_x;
+    f32* position_y;
+    f32* velocity_x;
+    f32* velocity_y;
+    u32* flags;
+    u32* generation;
+    u32* next_free;
+};
+
+// Capacity is rounded up to whole SIMD lanes. The arrays are cleared here
+// rather than trusting the arena to hand out zeroed memory.
+fn create_entity_store(FixedBufferAllocator* arena, u32 capacity)
+    -> EntityStore {
+    capacity = (capacity + 3) & ~3u;
+
+    let alloc_array = [&](usize element_size) {
+        void* array = arena->alloc_bytes(element_size * capacity, 64);
+        if (array) {
+            memset(array, 0, element_size * capacity);
+        }
+        return array;
+    };
+
+    EntityStore store = {};
+    store.capacity = capacity;
+    store.first_free = ENTITY_NO_FREE_SLOT;
+    store.position_x = (f32*)alloc_array(sizeof(f32));
+    store.position_y = (f32*)alloc_array(sizeof(f32));
+    store.velocity_x = (f32*)alloc_array(sizeof(f32));
+    store.velocity_y = (f32*)alloc_array(sizeof(f32));
+    store.flags = (u32*)alloc_array(sizeof(u32));
+    store.generation = (u32*)alloc_array(sizeof(u32));
+    store.next_free = (u32*)alloc_array(sizeof(u32));
+
+    return store;
+}
+
+// Returns a zeroed handle when the store is full.
+fn create_entity(EntityStore* store) -> EntityHandle {
+    u32 index;
+    if (store->first_free != ENTITY_NO_FREE_SLOT) {
+        index = store->first_free;
+        store->first_free = store->next_free[index];
+    } else if (store->high_index < store->capacity) {
+        index = store->high_index++;
+    } else {
+        SDL_Log("Entity store of %u entities is full", store->capacity);
+        return EntityHandle{};
+    }
+
+    store->generation[index] += 1;
+    if (store->generation[index] == 0) {
+        store->generation[index] = 1;
+    }
+
+    store->flags[index] = EntityAlive;
+    store->count += 1;
+
+    return EntityHandle{index, store->generation[index]};
+}
+
+fn is_entity_alive(EntityStore* store, EntityHandle handle) -> bool {
+    return handle.index < store->high_index &&
+           store->generation[handle.index] == handle.generation &&
+           (store->flags[handle.index] & EntityAlive);
+}
+
+// Returns false for handles that no longer resolve.
+fn destroy_entity(EntityStore* store, EntityHandle handle) -> bool {
+    if (!is_entity_alive(store, handle))
+        return false;
+
+    u32 index = handle.index;
+    store->flags[index] = 0;
+    store->velocity_x[index] = 0.0f;
+    store->velocity_y[index] = 0.0f;
+    store->generation[index] += 1;
+
+    store->next_free[index] = store->first_free;
+    store->first_free = index;
+    store->count -= 1;
+
+    return true;
+}
+
+// Moves every entity by its velocity over dt, bouncing off the edges of the
+// [0, max_x] x [0, max_y] world.
+fn integrate_entities(EntityStore* store, f32 dt, f32 max_x, f32 max_y)
+    -> void {
+    f32x4 dt4 = f32x4_set1(dt);
+    f32x4 zero = f32x4_set1(0.0f);
+    f32x4 max_x4 = f32x4_set1(max_x);
+    f32x4 max_y4 = f32x4_set1(max_y);
+
+    // Whole lanes past high_index are still inside capacity, and their
+    // velocity is zero.
+    for (u32 i = 0; i < store->high_index; i += 4) {
+        f32x4 velocity_x = f32x4_load(store->velocity_x + i);
+        f32x4 velocity_y = f32x4_load(store->velocity_y + i);
+        f32x4 x = f32x4_load(store->position_x + i) + velocity_x * dt4;
+        f32x4 y = f32x4_load(store->position_y + i) + velocity_y * dt4;
+
+        velocity_x = f32x4_select(
+            f32x4_less(x, zero),
+            f32x4_abs(velocity_x),
+            velocity_x
+        );
+        velocity_x = f32x4_select(
+            f32x4_greater(x, max_x4),
+            zero - f32x4_abs(velocity_x),
+            velocity_x
+        );
+        velocity_y = f32x4_select(
+            f32x4_less(y, zero),
+            f32x4_abs(velocity_y),
+            velocity_y
+        );
+        velocity_y = f32x4_select(
+            f32x4_greater(y, max_y4),
+            zero - f32x4_abs(velocity_y),
+            velocity_y
+        );
+
+        f32x4_store(store->position_x + i, f32x4_clamp(x, zero, max_x4));
+        f32x4_store(store->position_y + i, f32x4_clamp(y, zero, max_y4));
+        f32x4_store(store->velocity_x + i, velocity_x);
+        f32x4_store(store->velocity_y + i, velocity_y);
+    }
+}
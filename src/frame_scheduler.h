@@ -0,0 +1,105 @@
+#pragma once
+
+#include "core.h"
+
+// Paces the main loop to a target refresh rate. The wait is a coarse
+// SDL_DelayNS that stops short of the deadline, followed by a spin for the
+// last stretch, since OS sleeps routinely overshoot by a millisecond or more.
+// When a coarse sleep does overshoot, the spin margin grows to match.
+
+constexpr f32 DEFAULT_REFRESH_HZ = 60.0f;
+constexpr u64 MIN_SPIN_MARGIN_NS = SDL_NS_PER_MS;
+constexpr u64 MAX_SPIN_MARGIN_NS = 4 * SDL_NS_PER_MS;
+
+struct FrameScheduler {
+    f32 refresh_hz;
+    f32 seconds_per_frame;
+    u64 target_frame_ns;
+    u64 spin_margin_ns;
+
+    u64 next_deadline_ns;
+    u64 last_frame_end_ns;
+
+    u64 frame_count;
+    u64 missed_frames;
+};
+
+fn set_frame_scheduler_rate(FrameScheduler* scheduler, f32 refresh_hz)
+    -> void {
+    if (refresh_hz <= 0.0f) {
+        refresh_hz = DEFAULT_REFRESH_HZ;
+    }
+
+    scheduler->refresh_hz = refresh_hz;
+    scheduler->seconds_per_frame = 1.0f / refresh_hz;
+    scheduler->target_frame_ns = (u64)(SDL_NS_PER_SECOND / (f64)refresh_hz);
+}
+
+fn init_frame_scheduler(FrameScheduler* scheduler, f32 refresh_hz) -> void {
+    *scheduler = {};
+    set_frame_scheduler_rate(scheduler, refresh_hz);
+    scheduler->spin_margin_ns = MIN_SPIN_MARGIN_NS;
+
+    u64 now_ns = SDL_GetTicksNS();
+    scheduler->last_frame_end_ns = now_ns;
+    scheduler->next_deadline_ns = now_ns + scheduler->target_frame_ns;
+}
+
+// Called once at the end of every frame. When something else already paces
+// the loop (a presented VSync frame) it only does the bookkeeping; otherwise
+// it sleeps until the frame's deadline. Returns true when the frame missed.
+fn end_scheduled_frame(FrameScheduler* scheduler, bool paced_by_vsync)
+    -> bool {
+    u64 deadline_ns = scheduler->next_deadline_ns;
+
+    if (!paced_by_vsync) {
+        u64 now_ns = SDL_GetTicksNS();
+
+        if (now_ns + scheduler->spin_margin_ns < deadline_ns) {
+            SDL_DelayNS(deadline_ns - scheduler->spin_margin_ns - now_ns);
+
+            now_ns = SDL_GetTicksNS();
+            if (now_ns > deadline_ns) {
+                u64 overshoot_ns = now_ns - deadline_ns;
+                scheduler->spin_margin_ns = SDL_min(
+                    scheduler->spin_margin_ns + overshoot_ns,
+                    MAX_SPIN_MARGIN_NS
+                );
+            }
+        }
+
+        while (SDL_GetTicksNS() < deadline_ns) {
+            SDL_CPUPauseInstruction();
+        }
+    }
+
+    u64 frame_end_ns = SDL_GetTicksNS();
+    u64 frame_interval_ns = frame_end_ns - scheduler->last_frame_end_ns;
+    scheduler->last_frame_end_ns = frame_end_ns;
+    scheduler->frame_count += 1;
+
+    // A frame counts as missed once it runs half a frame past its slot.
+    bool missed = frame_interval_ns >
+                  scheduler->target_frame_ns + scheduler->target_frame_ns / 2;
+    if (missed) {
+        scheduler->missed_frames += 1;
+        SDL_LogDebug(
+            SDL_LOG_CATEGORY_APPLICATION,
+            "Missed frame: %.2f ms (target %.2f ms), %" SDL_PRIu64 " missed",
+            frame_interval_ns / 1000000.0,
+            scheduler->target_frame_ns / 1000000.0,
+            scheduler->missed_frames
+        );
+    }
+
+    // Under VSync, or after falling behind, restart the cadence from now
+    // instead of trying to catch up with a burst of short frames.
+    u64 target_frame_ns = scheduler->target_frame_ns;
+    if (paced_by_vsync || frame_end_ns > deadline_ns + target_frame_ns) {
+        scheduler->next_deadline_ns = frame_end_ns + target_frame_ns;
+    } else {
+        scheduler->next_deadline_ns = deadline_ns + target_frame_ns;
+    }
+
+    return missed;
+}
@@ -0,0 +1,346 @@
+#define PROFILE_CALL_SITE_BASE GAME_PROFILE_CALL_SITE_BASE
+#include "entity.h"
+#include "game.h"
+#include "tile_map.h"
+
+// Game code, built as a shared library (game.dll / libgame.so) and loaded by
+// the platform layer. A reload swaps this code out from under a running game,
+// so nothing here may hold state outside GameMemory: globals start over with
+// every reload.
+//
+// Persistent storage holds GameState and anything else that has to survive
+// the frame. Transient storage is scratch for within a frame; nothing here
+// needs any at the moment, and the frame's entry points check it's left
+// where they found it.
+//
+// game_update reads nothing but its GameInput and persistent storage: no
+// clocks, no SDL input state, and nothing the audio thread's timing can
+// change. Replaying recorded input from the recording's snapshot therefore
+// reproduces every frame exactly, which the platform checks by hashing
+// persistent storage (see --check-replay).
+
+constexpr f32 STEP_SIZE = 1.0f;
+constexpr f32 SCROLL_SPEED = 300.0f;     // pixels per second
+constexpr f32 TONE_SLIDE_SPEED = 600.0f; // hz per second
+constexpr u32 WORLD_ENTITY_COUNT = 100000;
+constexpr f32 WORLD_WIDTH = 4096.0f;
+constexpr f32 WORLD_HEIGHT = 4096.0f;
+constexpr f32 MAX_ENTITY_SPEED = 200.0f; // pixels per second
+constexpr u32 WORLD_ROOM_COUNT = 48;
+constexpr u32 TILE_MAP_SLOT_COUNT = 4096;
+
+constexpr u64 PLAYER_BITMAP_ID = asset_id("player");
+
+// Indexed by TileType, as premultiplied BGRA.
+constexpr u32 TILE_COLORS[] = {0x00000000, 0xFF505868, 0xFF282c34};
+
+struct GameState {
+    i32 blue_offset = 0;
+    i32 green_offset = 0;
+    f32 blue_offset_remainder = 0.0f;
+    f32 green_offset_remainder = 0.0f;
+    f32 tone_hz = 440.0f;
+    f32 tone_volume = 0.1f;
+    u8 preset_tones_idx = 5; // 440.0f;
+
+    EntityStore entities = {};
+    TileMap tile_map = {};
+};
+
+// Scatters the world's entities with a fixed seed, so every run, and every
+// replay of a recording, starts from the same world.
+fn spawn_entities(EntityStore* entities) -> void {
+    Uint64 seed = 0x5EED;
+
+    for (u32 i = 0; i < WORLD_ENTITY_COUNT; ++i) {
+        EntityHandle handle = create_entity(entities);
+        if (!handle.generation)
+            break;
+
+        u32 index = handle.index;
+        entities->position_x[index] = SDL_randf_r(&seed) * WORLD_WIDTH;
+        entities->position_y[index] = SDL_randf_r(&seed) * WORLD_HEIGHT;
+        entities->velocity_x[index] =
+            (SDL_randf_r(&seed) * 2.0f - 1.0f) * MAX_ENTITY_SPEED;
+        entities->velocity_y[index] =
+            (SDL_randf_r(&seed) * 2.0f - 1.0f) * MAX_ENTITY_SPEED;
+    }
+}
+
+// Lays out walled rooms at random across the entity world. Only the chunks
+// the rooms touch get allocated.
+fn build_rooms(TileMap* map, FixedBufferAllocator* arena) -> void {
+    constexpr i32 WORLD_TILES_X = (i32)WORLD_WIDTH >> MAP_TILE_SHIFT;
+    constexpr i32 WORLD_TILES_Y = (i32)WORLD_HEIGHT >> MAP_TILE_SHIFT;
+    Uint64 seed = 0x200A5;
+
+    for (u32 room = 0; room < WORLD_ROOM_COUNT; ++room) {
+        i32 width = 4 + (i32)(SDL_randf_r(&seed) * 9.0f);
+        i32 height = 4 + (i32)(SDL_randf_r(&seed) * 9.0f);
+        i32 min_x = (i32)(SDL_randf_r(&seed) * (WORLD_TILES_X - width));
+        i32 min_y = (i32)(SDL_randf_r(&seed) * (WORLD_TILES_Y - height));
+
+        for (i32 y = 0; y < height; ++y) {
+            for (i32 x = 0; x < width; ++x) {
+                bool edge =
+                    x == 0 || y == 0 || x == width - 1 || y == height - 1;
+                u8 tile = edge ? TileWall : TileFloor;
+                set_tile(map, arena, min_x + x, min_y + y, tile);
+            }
+        }
+    }
+}
+
+// GameState is the first allocation in persistent storage, so a freshly
+// loaded library finds it right where the previous one left it.
+fn get_game_state(GameMemory* memory) -> GameState* {
+    if (!memory->is_initialized) {
+        FixedBufferAllocator* persistent = &memory->persistent_storage;
+        GameState* state = persistent->alloc_initialized<GameState>();
+        state->entities = create_entity_store(persistent, WORLD_ENTITY_COUNT);
+        spawn_entities(&state->entities);
+        state->tile_map = create_tile_map(persistent, TILE_MAP_SLOT_COUNT);
+        build_rooms(&state->tile_map, persistent);
+
+        memory->is_initialized = true;
+    }
+
+    return (GameState*)memory->persistent_storage.memory;
+}
+
+// Pushes a rect for every tile on screen, with the screen's top-left corner
+// at (camera_x, camera_y) in the world. Only chunks overlapping the screen
+// are looked up.
+fn push_tile_map(
+    RenderCommands* commands,
+    TileMap* map,
+    i32 camera_x,
+    i32 camera_y
+) -> void {
+    constexpr i32 CHUNK_PIXEL_SHIFT = MAP_TILE_SHIFT + TILE_CHUNK_SHIFT;
+
+    i32 first_chunk_x = camera_x >> CHUNK_PIXEL_SHIFT;
+    i32 first_chunk_y = camera_y >> CHUNK_PIXEL_SHIFT;
+    i32 last_chunk_x = (camera_x + commands->width - 1) >> CHUNK_PIXEL_SHIFT;
+    i32 last_chunk_y = (camera_y + commands->height - 1) >> CHUNK_PIXEL_SHIFT;
+
+    for (i32 chunk_y = first_chunk_y; chunk_y <= last_chunk_y; ++chunk_y) {
+        for (i32 chunk_x = first_chunk_x; chunk_x <= last_chunk_x; ++chunk_x) {
+            TileChunk* chunk = get_tile_chunk(map, chunk_x, chunk_y);
+            if (!chunk)
+                continue;
+
+            // The chunk's top-left corner on screen.
+            i32 origin_x = (chunk_x << CHUNK_PIXEL_SHIFT) - camera_x;
+            i32 origin_y = (chunk_y << CHUNK_PIXEL_SHIFT) - camera_y;
+
+            for (i32 y = 0; y < TILE_CHUNK_DIM; ++y) {
+                i32 tile_y = origin_y + (y << MAP_TILE_SHIFT);
+                if (tile_y + MAP_TILE_PIXELS <= 0 || tile_y >= commands->height)
+                    continue;
+
+                for (i32 x = 0; x < TILE_CHUNK_DIM; ++x) {
+                    u8 tile = chunk->tiles[y * TILE_CHUNK_DIM + x];
+                    i32 tile_x = origin_x + (x << MAP_TILE_SHIFT);
+                    if (tile == TileEmpty || tile_x + MAP_TILE_PIXELS <= 0 ||
+                        tile_x >= commands->width)
+                        continue;
+
+                    push_rect(
+                        commands,
+                        (f32)tile_x,
+                        (f32)tile_y,
+                        (f32)(tile_x + MAP_TILE_PIXELS),
+                        (f32)(tile_y + MAP_TILE_PIXELS),
+                        TILE_COLORS[tile]
+                    );
+                }
+            }
+        }
+    }
+}
+
+// The gradient scrolls with the camera, the tile map is drawn over it, and the
+// player's sprite, if the asset pack has one, sits on top at the centre. The
+// camera's top-left corner sits at (blue_offset, green_offset) in the world.
+fn render_world(
+    GameMemory* memory,
+    GameState* state,
+    RenderCommands* commands
+) -> void {
+    TIMED_BLOCK("render_world");
+
+    push_gradient(commands, state->blue_offset, state->green_offset);
+    push_tile_map(
+        commands,
+        &state->tile_map,
+        state->blue_offset,
+        state->green_offset
+    );
+
+    Bitmap player = get_asset_bitmap(memory->assets, PLAYER_BITMAP_ID);
+    if (player.pixels) {
+        push_bitmap(
+            commands,
+            &player,
+            (commands->width - player.width) * 0.5f,
+            (commands->height - player.height) * 0.5f
+        );
+    }
+}
+
+fn update(GameInput* input, GameState* state) -> bool {
+    TIMED_BLOCK("update");
+
+    f32 dt = input->dt_for_frame;
+    bool keep_running = true;
+
+    for (GameControllerInput& controller : input->controllers) {
+        if (!controller.is_connected)
+            continue;
+
+        f32 move_x = 0.0f;
+        f32 move_y = 0.0f;
+
+        if (controller.is_analog) {
+            move_x = controller.stick_average_x;
+            move_y = controller.stick_average_y;
+        }
+
+        if (controller.is_down(ButtonMoveLeft))
+            move_x = -1.0f;
+        if (controller.is_down(ButtonMoveRight))
+            move_x = 1.0f;
+        if (controller.is_down(ButtonMoveUp))
+            move_y = -1.0f;
+        if (controller.is_down(ButtonMoveDown))
+            move_y = 1.0f;
+
+        // Keep the sub-pixel part so slow or high-refresh frames still add
+        // up to the same distance per second.
+        f32 blue_delta = move_x * STEP_SIZE * SCROLL_SPEED * dt +
+                         state->blue_offset_remainder;
+        f32 green_delta = move_y * STEP_SIZE * SCROLL_SPEED * dt +
+                          state->green_offset_remainder;
+
+        state->blue_offset += (i32)blue_delta;
+        state->green_offset += (i32)green_delta;
+        state->blue_offset_remainder = blue_delta - (i32)blue_delta;
+        state->green_offset_remainder = green_delta - (i32)green_delta;
+
+        if (controller.is_down(ButtonActionUp)) {
+            state->tone_hz += TONE_SLIDE_SPEED * dt;
+            if (state->tone_hz > 2000.0f)
+                state->tone_hz = 2000.0f;
+        }
+
+        if (controller.is_down(ButtonActionDown)) {
+            state->tone_hz -= TONE_SLIDE_SPEED * dt;
+            if (state->tone_hz < 100.0f)
+                state->tone_hz = 100.0f;
+        }
+    }
+
+    // One-off actions go by the events, so every press counts even when
+    // several land in the same frame.
+    for (u32 i = 0; i < input->event_count; ++i) {
+        InputEvent* event = &input->events[i];
+        if (!event->is_down)
+            continue;
+
+        switch (event->button) {
+            case ButtonStart: {
+                keep_running = false;
+                break;
+            }
+
+            case ButtonActionRight: {
+                if (state->preset_tones_idx + 1 >= TONES_LEN) {
+                    state->preset_tones_idx = 0;
+                } else {
+                    state->preset_tones_idx += 1;
+                }
+
+                state->tone_hz = TONES[state->preset_tones_idx];
+                break;
+            }
+
+            case ButtonActionLeft: {
+                if (state->preset_tones_idx == 0) {
+                    state->preset_tones_idx = TONES_LEN - 1;
+                } else {
+                    state->preset_tones_idx -= 1;
+                }
+
+                state->tone_hz = TONES[state->preset_tones_idx];
+                break;
+            }
+
+            case ButtonMute: {
+                state->tone_volume = 0.0f;
+                break;
+            }
+
+            case ButtonUnmute: {
+                state->tone_volume = 0.1f;
+                break;
+            }
+        }
+    }
+
+    return keep_running;
+}
+
+// Forwards tone and volume changes to the mixer running on the audio thread.
+fn send_mixer_parameters(Mixer* mixer, GameState* state) -> void {
+    TIMED_BLOCK("send_mixer_parameters");
+
+    MixerCommandRing* commands = &mixer->commands;
+
+    if (state->tone_hz != mixer->sent_tone_hz &&
+        push_mixer_command(commands, {MixerSetToneHz, state->tone_hz})) {
+        mixer->sent_tone_hz = state->tone_hz;
+    }
+
+    if (state->tone_volume != mixer->sent_volume &&
+        push_mixer_command(commands, {MixerSetVolume, state->tone_volume})) {
+        mixer->sent_volume = state->tone_volume;
+    }
+}
+
+export fn game_update(GameMemory* memory, GameInput* input) -> bool {
+    PROFILE_USE(memory->profiler);
+    GameState* state = get_game_state(memory);
+
+    bool keep_running = update(input, state);
+    {
+        TIMED_BLOCK("integrate_entities");
+        integrate_entities(
+            &state->entities,
+            input->dt_for_frame,
+            WORLD_WIDTH,
+            WORLD_HEIGHT
+        );
+    }
+    send_mixer_parameters(memory->mixer, state);
+    check_arena(&memory->transient_storage);
+
+    return keep_running;
+}
+
+export fn game_render(GameMemory* memory, RenderCommands* commands) -> void {
+    PROFILE_USE(memory->profiler);
+    GameState* state = get_game_state(memory);
+
+    render_world(memory, state, commands);
+    check_arena(&memory->transient_storage);
+}
+
+// Runs on the audio thread, with the platform holding the stream lock.
+export fn game_get_sound_samples(
+    Mixer* mixer,
+    f32* samples,
+    u32 sample_count
+) -> void {
+    mix_samples(mixer, samples, sample_count);
+}
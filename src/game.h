@@ -0,0 +1,173 @@
+#pragma once
+
+#include "asset_pack.h"
+#include "async_loader.h"
+#include "async_writer.h"
+#include "core.h"
+#include "mixer.h"
+#include "profile.h"
+#include "render.h"
+#include "render_commands.h"
+#include "work_queue.h"
+
+// The interface between the platform layer (main.cpp) and the game code
+// (game.cpp). The game is built as its own shared library so it can be rebuilt
+// and reloaded while the platform keeps running. Only plain data crosses the
+// boundary, and the game keeps all of its state in GameMemory, which the
+// platform owns, so a reload picks up exactly where the old code left off.
+
+constexpr u8 TONES_LEN = 7;
+constexpr f32 TONES[TONES_LEN] = {
+    261.63f,
+    293.66f,
+    329.63f,
+    349.23f,
+    392.00f,
+    440.00f,
+    493.88f,
+};
+
+// Bit positions in GameControllerInput's button masks.
+enum GameButton : u8 {
+    ButtonMoveUp,
+    ButtonMoveDown,
+    ButtonMoveLeft,
+    ButtonMoveRight,
+    ButtonActionUp,
+    ButtonActionDown,
+    ButtonActionLeft,
+    ButtonActionRight,
+    ButtonLeftShoulder,
+    ButtonRightShoulder,
+    ButtonBack,
+    ButtonStart,
+    // Keyboard only.
+    ButtonMute,
+    ButtonUnmute,
+    GameButtonCount,
+};
+
+constexpr u32 MAX_INPUT_EVENTS = 64;
+constexpr u32 MAX_GAMEPADS = 4;
+constexpr u32 MAX_CONTROLLERS = 1 + MAX_GAMEPADS;
+
+// One press or release, stamped with when the platform saw it.
+struct InputEvent {
+    u64 timestamp_ns;
+    u8 controller_index;
+    u8 button;
+    bool is_down;
+};
+
+// Buttons are one bit each in three masks, so a whole controller is 16
+// bytes and every controller fits in two cache lines. A tap that starts and
+// ends inside one frame sets both pressed and released; how many times it
+// happened is in GameInput's events.
+struct GameControllerInput {
+    bool is_connected = false;
+    bool is_analog = false;
+
+    // Held at the end of the frame.
+    u16 ended_down = 0;
+    // Went down, or came up, at least once during the frame.
+    u16 pressed = 0;
+    u16 released = 0;
+
+    f32 stick_average_x = 0.0f;
+    f32 stick_average_y = 0.0f;
+
+    fn is_down(GameButton button) -> bool {
+        return ended_down & (1u << button);
+    }
+
+    fn was_pressed(GameButton button) -> bool {
+        return pressed & (1u << button);
+    }
+
+    fn was_released(GameButton button) -> bool {
+        return released & (1u << button);
+    }
+
+    fn process_transition(GameButton button, bool is_down) -> void {
+        u16 bit = (u16)(1u << button);
+        if (is_down && !(ended_down & bit)) {
+            ended_down |= bit;
+            pressed |= bit;
+        } else if (!is_down && (ended_down & bit)) {
+            ended_down &= (u16)~bit;
+            released |= bit;
+        }
+    }
+};
+
+static_assert(GameButtonCount <= 16);
+static_assert(sizeof(GameControllerInput) == 16);
+
+struct GameInput {
+    f32 dt_for_frame = 0.0f;
+
+    union {
+        GameControllerInput controllers[MAX_CONTROLLERS] = {};
+
+        struct {
+            GameControllerInput keyboard_input;
+            GameControllerInput gamepads[MAX_GAMEPADS];
+        };
+    };
+
+    // This frame's presses and releases in the order they happened, across
+    // all controllers. The button states above already include them all;
+    // events past MAX_INPUT_EVENTS are only missing from this list.
+    u32 event_count = 0;
+    InputEvent events[MAX_INPUT_EVENTS] = {};
+};
+
+struct Profiler;
+
+// Platform services the game calls back into. Loads run on the platform's I/O
+// threads and land in whichever arena the game passes; writes replace their
+// file atomically once they reach the disk. The game polls for finished ones
+// once a frame.
+typedef bool PlatformBeginAsyncLoad(
+    const char* filename,
+    FixedBufferAllocator* arena,
+    u64 user_data
+);
+typedef u32 PlatformPollAsyncLoads(
+    AsyncLoadCompletion* completions,
+    u32 max_count
+);
+typedef bool PlatformBeginAsyncWrite(
+    const char* filename,
+    const void* data,
+    usize size,
+    u64 user_data
+);
+typedef u32 PlatformPollAsyncWrites(
+    AsyncWriteCompletion* completions,
+    u32 max_count
+);
+
+struct GameMemory {
+    bool is_initialized;
+    FixedBufferAllocator persistent_storage;
+    FixedBufferAllocator transient_storage;
+
+    // Platform services. These outlive any one load of the game library.
+    Mixer* mixer;
+    Profiler* profiler;
+    // Empty when no pack was found.
+    AssetPack* assets;
+    PlatformBeginAsyncLoad* begin_async_load;
+    PlatformPollAsyncLoads* poll_async_loads;
+    PlatformBeginAsyncWrite* begin_async_write;
+    PlatformPollAsyncWrites* poll_async_writes;
+};
+
+// Exported by the game library as game_update, game_render and
+// game_get_sound_samples. game_update returns false once the game wants to
+// quit. game_render only describes the frame; the platform draws the
+// commands while the next game_update runs.
+typedef bool GameUpdate(GameMemory* memory, GameInput* input);
+typedef void GameRender(GameMemory* memory, RenderCommands* commands);
+typedef MixerFill GameGetSoundSamples;
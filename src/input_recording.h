@@ -0,0 +1,313 @@
+#pragma once
+
+#include "core.h"
+#include "game.h"
+
+// Records a session as a snapshot of the game's persistent storage followed by
+// every frame's GameInput, and plays it back by restoring the snapshot and
+// feeding the recorded inputs to the game in place of the live ones. The game
+// keeps all of its state in persistent storage, so playback reproduces the
+// recorded frames exactly, which makes recordings usable as benchmark input.
+//
+// The snapshot is a single copy of the arena's used prefix, never of
+// individual objects, so its cost is a memcpy of however much the game has
+// actually allocated. Transient storage is scratch and isn't copied, but its
+// allocation mark is rewound along with the snapshot so the game's transient
+// allocations land in the same place every loop.
+//
+// The snapshot holds pointers into persistent storage, so it only makes sense
+// to an arena at the address it was recorded at. The header keeps that
+// address, and playback refuses a recording made at any other.
+//
+// Each recorded frame's input is followed by a hash of persistent storage as
+// that frame's update left it. Playback can then show the first frame where
+// the game stopped doing what it did when it was recorded.
+
+constexpr u32 INPUT_RECORDING_MAGIC = 0x494d4848; // "HHMI"
+constexpr u32 INPUT_RECORDING_VERSION = 5;
+
+struct InputRecordingHeader {
+    u32 magic;
+    u32 version;
+    u32 input_size;
+    u32 reserved;
+    u64 snapshot_size;
+    u64 transient_used;
+    u64 storage_base;
+};
+
+enum InputRecordingMode : u8 {
+    InputRecordingIdle,
+    InputRecordingRecording,
+    InputRecordingPlayingBack,
+};
+
+struct InputRecorder {
+    InputRecordingMode mode;
+    SDL_IOStream* file;
+    i64 inputs_offset;
+    u64 frame_count;
+
+    FixedBufferAllocator snapshot_storage;
+    u8* snapshot;
+    usize snapshot_size;
+    usize transient_used;
+};
+
+static fn hash_round(u64 acc, u64 word) -> u64 {
+    acc += word * 0xC2B2AE3D27D4EB4Full;
+    acc = (acc << 31) | (acc >> 33);
+    return acc * 0x9E3779B97F4A7C15ull;
+}
+
+// A fast, non-cryptographic hash of the used part of persistent storage. Four
+// independent lanes of 8 bytes each keep the multiplies from waiting on each
+// other, so it runs at close to memory speed.
+fn hash_game_state(GameMemory* memory) -> u64 {
+    const u8* data = memory->persistent_storage.memory;
+    usize size = memory->persistent_storage.used;
+
+    u64 lanes[4] = {1, 2, 3, 4};
+    usize offset = 0;
+    for (; offset + 32 <= size; offset += 32) {
+        for (i32 lane = 0; lane < 4; ++lane) {
+            u64 word;
+            memcpy(&word, data + offset + lane * 8, sizeof(word));
+            lanes[lane] = hash_round(lanes[lane], word);
+        }
+    }
+
+    u64 hash = size;
+    for (u64 lane : lanes) {
+        hash = hash_round(hash, lane);
+    }
+    for (; offset < size; ++offset) {
+        hash = hash_round(hash, data[offset]);
+    }
+
+    return hash;
+}
+
+// The snapshot buffer can hold the whole arena, but only commits as much as
+// the largest snapshot so far.
+fn init_input_recorder(InputRecorder* recorder, usize capacity) -> bool {
+    *recorder = {};
+    recorder->snapshot_storage = FixedBufferAllocator::reserve(capacity);
+
+    return recorder->snapshot_storage.memory != nullptr;
+}
+
+static fn alloc_snapshot(InputRecorder* recorder, usize size) -> u8* {
+    FixedBufferAllocator* storage = &recorder->snapshot_storage;
+    storage->reset();
+    recorder->snapshot = (u8*)storage->alloc_bytes(size, 64);
+
+    return recorder->snapshot;
+}
+
+fn snapshot_game_memory(InputRecorder* recorder, GameMemory* memory) -> void {
+    u64 start_ns = SDL_GetTicksNS();
+
+    usize size = memory->persistent_storage.used;
+    memcpy(
+        alloc_snapshot(recorder, size),
+        memory->persistent_storage.memory,
+        size
+    );
+    recorder->snapshot_size = size;
+    recorder->transient_used = memory->transient_storage.used;
+
+    SDL_Log(
+        "Snapshot of %zu bytes took %.3f ms",
+        size,
+        (SDL_GetTicksNS() - start_ns) / 1000000.0
+    );
+}
+
+fn restore_game_memory(InputRecorder* recorder, GameMemory* memory) -> void {
+    usize size = recorder->snapshot_size;
+    memcpy(memory->persistent_storage.memory, recorder->snapshot, size);
+    memory->persistent_storage.used = size;
+    memory->transient_storage.used = recorder->transient_used;
+    memory->is_initialized = size > 0;
+}
+
+fn begin_recording(
+    InputRecorder* recorder,
+    GameMemory* memory,
+    const char* filename
+) -> bool {
+    SDL_assert(recorder->mode == InputRecordingIdle);
+
+    recorder->file = SDL_IOFromFile(filename, "wb");
+    if (!recorder->file) {
+        SDL_Log("Failed to create file %s: %s", filename, SDL_GetError());
+        return false;
+    }
+
+    snapshot_game_memory(recorder, memory);
+
+    InputRecordingHeader header = {
+        .magic = INPUT_RECORDING_MAGIC,
+        .version = INPUT_RECORDING_VERSION,
+        .input_size = sizeof(GameInput),
+        .reserved = 0,
+        .snapshot_size = recorder->snapshot_size,
+        .transient_used = recorder->transient_used,
+        .storage_base = (u64)(uintptr_t)memory->persistent_storage.memory,
+    };
+    if (SDL_WriteIO(recorder->file, &header, sizeof(header)) !=
+            sizeof(header) ||
+        SDL_WriteIO(recorder->file, recorder->snapshot, header.snapshot_size) !=
+            header.snapshot_size) {
+        SDL_Log("Failed to write complete data to file");
+        SDL_CloseIO(recorder->file);
+        recorder->file = nullptr;
+        return false;
+    }
+
+    recorder->mode = InputRecordingRecording;
+    recorder->frame_count = 0;
+    SDL_Log("Recording input to %s", filename);
+
+    return true;
+}
+
+// Call after the frame's update, with the state it left behind.
+fn record_input(InputRecorder* recorder, GameInput* input, u64 state_hash)
+    -> void {
+    SDL_assert(recorder->mode == InputRecordingRecording);
+
+    if (SDL_WriteIO(recorder->file, input, sizeof(*input)) != sizeof(*input) ||
+        SDL_WriteIO(recorder->file, &state_hash, sizeof(state_hash)) !=
+            sizeof(state_hash)) {
+        SDL_Log("Failed to record input: %s", SDL_GetError());
+        return;
+    }
+
+    recorder->frame_count += 1;
+}
+
+fn end_recording(InputRecorder* recorder) -> void {
+    SDL_assert(recorder->mode == InputRecordingRecording);
+
+    SDL_CloseIO(recorder->file);
+    recorder->file = nullptr;
+    recorder->mode = InputRecordingIdle;
+
+    SDL_Log("Recorded %" SDL_PRIu64 " frames", recorder->frame_count);
+}
+
+// Restarts playback from the first recorded frame.
+fn rewind_playback(InputRecorder* recorder, GameMemory* memory) -> void {
+    SDL_assert(recorder->mode == InputRecordingPlayingBack);
+
+    restore_game_memory(recorder, memory);
+    SDL_SeekIO(recorder->file, recorder->inputs_offset, SDL_IO_SEEK_SET);
+    recorder->frame_count = 0;
+}
+
+fn begin_playback(
+    InputRecorder* recorder,
+    GameMemory* memory,
+    const char* filename
+) -> bool {
+    SDL_assert(recorder->mode == InputRecordingIdle);
+
+    SDL_IOStream* file = SDL_IOFromFile(filename, "rb");
+    if (!file) {
+        SDL_Log("Failed to open file %s: %s", filename, SDL_GetError());
+        return false;
+    }
+
+    u64 storage_base = (u64)(uintptr_t)memory->persistent_storage.memory;
+    InputRecordingHeader header = {};
+    if (SDL_ReadIO(file, &header, sizeof(header)) != sizeof(header) ||
+        header.magic != INPUT_RECORDING_MAGIC ||
+        header.version != INPUT_RECORDING_VERSION ||
+        header.input_size != sizeof(GameInput) ||
+        header.storage_base != storage_base ||
+        header.snapshot_size > recorder->snapshot_storage.capacity ||
+        header.transient_used > memory->transient_storage.capacity) {
+        SDL_Log("%s is not a recording this build can play", filename);
+        SDL_CloseIO(file);
+        return false;
+    }
+
+    u8* snapshot = alloc_snapshot(recorder, header.snapshot_size);
+    if (SDL_ReadIO(file, snapshot, header.snapshot_size) !=
+        header.snapshot_size) {
+        SDL_Log("Failed to read entire file");
+        SDL_CloseIO(file);
+        return false;
+    }
+
+    recorder->file = file;
+    recorder->snapshot_size = header.snapshot_size;
+    recorder->transient_used = header.transient_used;
+    recorder->inputs_offset = SDL_TellIO(file);
+    recorder->mode = InputRecordingPlayingBack;
+
+    rewind_playback(recorder, memory);
+    SDL_Log("Playing back input from %s", filename);
+
+    return true;
+}
+
+// Reads the next recorded frame's input and the hash of the state its update
+// should leave. Returns false at the end of the recording.
+fn read_recorded_frame(
+    InputRecorder* recorder,
+    GameInput* input,
+    u64* state_hash
+) -> bool {
+    SDL_assert(recorder->mode == InputRecordingPlayingBack);
+
+    if (SDL_ReadIO(recorder->file, input, sizeof(*input)) != sizeof(*input) ||
+        SDL_ReadIO(recorder->file, state_hash, sizeof(*state_hash)) !=
+            sizeof(*state_hash)) {
+        return false;
+    }
+
+    recorder->frame_count += 1;
+    return true;
+}
+
+// Replaces input with the next recorded frame, looping back to the snapshot
+// at the end. Returns false if the recording has no frames to play.
+fn playback_input(
+    InputRecorder* recorder,
+    GameMemory* memory,
+    GameInput* input,
+    u64* state_hash
+) -> bool {
+    if (read_recorded_frame(recorder, input, state_hash)) {
+        return true;
+    }
+
+    if (recorder->frame_count == 0) {
+        return false;
+    }
+
+    rewind_playback(recorder, memory);
+    return read_recorded_frame(recorder, input, state_hash);
+}
+
+fn end_playback(InputRecorder* recorder) -> void {
+    SDL_assert(recorder->mode == InputRecordingPlayingBack);
+
+    SDL_CloseIO(recorder->file);
+    recorder->file = nullptr;
+    recorder->mode = InputRecordingIdle;
+}
+
+fn destroy_input_recorder(InputRecorder* recorder) -> void {
+    if (recorder->mode == InputRecordingRecording) {
+        end_recording(recorder);
+    } else if (recorder->mode == InputRecordingPlayingBack) {
+        end_playback(recorder);
+    }
+
+    recorder->snapshot_storage.destroy();
+    *recorder = {};
+}
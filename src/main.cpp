@@ -1,115 +1,225 @@
+#include "asset_pack.h"
+#include "async_loader.h"
+#include "async_writer.h"
 #include "core.h"
+#include "entity.h"
+#include "frame_scheduler.h"
+#include "game.h"
+#include "input_recording.h"
+#include "mapped_file.h"
+#include "mixer.h"
+#include "profile.h"
+#include "rasterizer.h"
+#include "render.h"
+#include "render_commands.h"
+#include "work_queue.h"
+
+#include <cstdio>
+
+#if defined(SDL_PLATFORM_WINDOWS)
+#include <psapi.h>
+#endif
 
-constexpr f32 STEP_SIZE = 1.0f;
 constexpr f32 SAMPLE_RATE = 48000.0;
+constexpr const char* AUDIO_DEVICE_SAMPLE_FRAMES = "256"; // ~5.3 ms
 constexpr i16 DEADZONE = 8000;
-constexpr u8 TONES_LEN = 7;
-constexpr f32 TONES[TONES_LEN] = {
-    261.63f,
-    293.66f,
-    329.63f,
-    349.23f,
-    392.00f,
-    440.00f,
-    493.88f,
-};
-
-struct ButtonState {
-    bool ended_down = false;
-    bool half_transition_count = false;
-
-    ButtonState() = default;
-
-    fn was_pressed() -> bool { return ended_down && half_transition_count; }
+// GameInput's controllers are the keyboard, then one per gamepad slot.
+constexpr u8 KEYBOARD_CONTROLLER_INDEX = 0;
+constexpr u8 FIRST_GAMEPAD_CONTROLLER_INDEX = 1;
+constexpr u32 MAX_PENDING_INPUT_EVENTS = 256;
+constexpr const char* INPUT_RECORDING_FILE = "input_recording.hmi";
+constexpr const char* DEFAULT_ASSET_PACK_NAME = "assets.hpak";
+constexpr i32 DEFAULT_BACKBUFFER_WIDTH = 960;
+constexpr i32 DEFAULT_BACKBUFFER_HEIGHT = 540;
+constexpr usize WORKER_SCRATCH_SIZE = KB(256);
+constexpr usize RENDER_FRAME_ARENA_SIZE = MB(16);
+constexpr u32 RENDER_COMMAND_BUFFER_SIZE = MB(4);
+// One frame being drawn while the one before it is uploaded and presented.
+// A third would only wait: there's one batch on the render queue at a time,
+// and uploads copy the pixels out before SDL_UpdateTexture returns.
+constexpr u32 RENDER_FRAME_COUNT = 2;
+constexpr usize PERSISTENT_STORAGE_SIZE = GB(1);
+constexpr usize TRANSIENT_STORAGE_SIZE = GB(1);
+// Far from anywhere the OS puts things on its own. Reserved at the same
+// address every run, so pointers saved in a recording's snapshot still point
+// at the right things when it's played back.
+constexpr usize GAME_MEMORY_BASE_ADDRESS = sizeof(void*) == 8 ? TB(2) : 0;
+
+#if defined(SDL_PLATFORM_WINDOWS)
+constexpr const char* GAME_LIBRARY_NAME = "game";
+constexpr const char* GAME_LIBRARY_EXTENSION = ".dll";
+#elif defined(SDL_PLATFORM_APPLE)
+constexpr const char* GAME_LIBRARY_NAME = "libgame";
+constexpr const char* GAME_LIBRARY_EXTENSION = ".dylib";
+#else
+constexpr const char* GAME_LIBRARY_NAME = "libgame";
+constexpr const char* GAME_LIBRARY_EXTENSION = ".so";
+#endif
 
-    fn was_released() -> bool { return !ended_down && half_transition_count; }
+struct GameSound {
+    SDL_AudioStream* audio_stream = nullptr;
+    i32 reported_underruns = 0;
 
-    fn process_button_state(ButtonState* prev_state, bool is_down) -> void {
-        ended_down = is_down;
-        half_transition_count =
-            (prev_state->ended_down != ended_down) ? true : false;
-    }
+    Mixer mixer = {};
 };
 
-struct GameControllerInput {
-    bool is_connected = false;
-    bool is_analog = false;
-
-    f32 stick_average_x = 0.0f;
-    f32 stick_average_y = 0.0f;
-
-    union {
-        ButtonState buttons[12] = {};
-        struct {
-            ButtonState move_up;
-            ButtonState move_down;
-            ButtonState move_left;
-            ButtonState move_right;
-
-            ButtonState action_up;
-            ButtonState action_down;
-            ButtonState action_left;
-            ButtonState action_right;
-
-            ButtonState left_shoulder;
-            ButtonState right_shoulder;
-
-            ButtonState back;
-            ButtonState start;
-        };
-    };
+// The loaded game library. Each load works from a fresh copy, so the build
+// can overwrite the original (Windows locks a loaded DLL) and a half-written
+// file is never what gets loaded.
+struct GameCode {
+    SDL_SharedObject* library = nullptr;
+    SDL_Time last_write_time = 0;
+    u32 load_count = 0;
+
+    GameUpdate* update = nullptr;
+    GameRender* render = nullptr;
+    GameGetSoundSamples* get_sound_samples = nullptr;
+
+    char source_path[1024] = {};
+    char loaded_path[1024] = {};
+    char lock_path[1024] = {};
 };
 
-struct GameInput {
-    SDL_Gamepad* gamepad = nullptr;
-    bool controller_connected = false;
-
-    f32 dt_for_frame = 0.0f;
-
-    union {
-        GameControllerInput controllers[5] = {};
-
-        struct {
-            GameControllerInput keyboard_input;
-            GameControllerInput controller_input0;
-            GameControllerInput controller_input1;
-            GameControllerInput controller_input2;
-            GameControllerInput controller_input3;
-        };
-    };
+// One frame's render commands, the tiles they were sorted into and the
+// backbuffer they're drawn into. Frames take turns, so the game can describe
+// one and the render queue draw another while a third is being presented.
+struct RenderFrame {
+    FixedBufferAllocator arena;
+    RenderCommands commands;
+    RenderBatch batch;
+    OffscreenBuffer buffer;
+    RenderDamage damage;
+    // When the oldest input this frame reacts to happened, or 0 for none.
+    u64 input_ns;
 };
 
-struct GameSound {
-    SDL_AudioStream* audio_stream = nullptr;
-    f32 tone_volume = 0.1;
-    f32 wave_period = 0.0;
+// Input-to-present latency, from the timestamp of the oldest key or button
+// event a frame reacts to, and how long uploads and presents held up the
+// main thread, reported once a second. Enable with SDL_LOGGING="render=debug".
+struct PresentTimings {
+    u64 frame_count = 0;
+    u64 input_frame_count = 0;
+    u64 total_latency_ns = 0;
+    u64 max_latency_ns = 0;
+    u64 total_upload_ns = 0;
+    u64 max_upload_ns = 0;
+    u64 total_present_ns = 0;
+    u64 max_present_ns = 0;
+    u64 last_report_ns = 0;
 };
 
 struct Game {
     SDL_Window* window = nullptr;
     SDL_Renderer* renderer = nullptr;
     SDL_Texture* texture = nullptr;
-    GameInput input = {};
+    // Slots keep their gamepad for as long as it stays connected.
+    SDL_Gamepad* gamepads[MAX_GAMEPADS] = {};
+    const GradientKernelInfo* gradient_kernel = nullptr;
+    WorkQueue render_queue = {};
+    // One reservation, split into every render frame's arena.
+    FixedBufferAllocator render_arena = {};
+    RenderFrame render_frames[RENDER_FRAME_COUNT] = {};
+    u32 next_render_frame = 0;
+    // The frame the render queue is drawing, if any.
+    RenderFrame* rendering = nullptr;
+    RenderTimings render_timings = {};
+    // What the texture was last uploaded from.
+    RenderDamage texture_damage = {};
+    PresentTimings present_timings = {};
+    // Presses and releases seen since the last handle_input, oldest first.
+    InputEvent pending_input[MAX_PENDING_INPUT_EVENTS] = {};
+    u32 pending_input_count = 0;
+    // When the oldest input this frame reacts to happened, or 0 for none.
+    u64 input_ns = 0;
+    AsyncLoader loader = {};
+    AsyncWriter writer = {};
+    AssetPack assets = {};
+    FrameScheduler scheduler = {};
+    GameCode code = {};
+    GameMemory memory = {};
+    GameInput inputs[2] = {};
+    InputRecorder recorder = {};
     GameSound sound = {};
     i32 win_width = 1280;
     i32 win_height = 720;
+    // Frames are drawn at this size whatever the window's, and the renderer
+    // scales them up: to the largest whole multiple that fits with
+    // integer_scale, or filtered to fill as much as the aspect ratio allows.
+    i32 backbuffer_width = DEFAULT_BACKBUFFER_WIDTH;
+    i32 backbuffer_height = DEFAULT_BACKBUFFER_HEIGHT;
+    bool integer_scale = false;
     bool win_focused = true;
+    // Present even if nothing was drawn, e.g. after the window was uncovered.
+    bool needs_present = false;
+    // Whether the last render() presented, and so waited on VSync.
+    bool presented = false;
     bool running = true;
-};
-
-struct GameState {
-    i32 blue_offset = 0;
-    i32 green_offset = 0;
-    f32 tone_hz = 440.0f;
-    u8 preset_tones_idx = 5; // 440.0f;
+    bool headless = false;
+    bool vsync = false;
+    // Lockstep: every update steps by the same fixed dt at a fixed rate,
+    // whatever the display does, and playback checks each frame's state
+    // against the hash recorded with it.
+    bool deterministic = false;
+    // The hash the current playback frame's update should leave behind.
+    u64 expected_state_hash = 0;
+    bool state_diverged = false;
+    bool huge_pages = false;
+    const char* assets_path = nullptr;
+
+    u64 startup_ns = 0;
+    usize startup_resident_bytes = 0;
 };
 
 static Game game = {};
 
-fn resize_texture(i32 width, i32 height) -> bool {
-    if (game.texture) {
-        SDL_DestroyTexture(game.texture);
-        game.texture = nullptr;
+// Waits for the render queue to finish drawing the frame in flight, if any.
+// Returns that frame.
+fn finish_rendering() -> RenderFrame* {
+    RenderFrame* frame = game.rendering;
+    if (!frame)
+        return nullptr;
+
+    TIMED_BLOCK("finish_rendering");
+    complete_all_work(&game.render_queue);
+    record_render_timings(
+        &game.render_timings,
+        &frame->batch,
+        game.render_queue.thread_count + 1
+    );
+    game.rendering = nullptr;
+
+    return frame;
+}
+
+fn invalidate_backbuffers() -> void {
+    for (RenderFrame& frame : game.render_frames) {
+        invalidate_render_damage(&frame.damage);
+    }
+    invalidate_render_damage(&game.texture_damage);
+}
+
+// Every frame draws into its own backbuffer, copied to the texture to
+// present. Whatever was being drawn at the old size is dropped.
+fn resize_backbuffers(i32 width, i32 height) -> bool {
+    finish_rendering();
+    invalidate_backbuffers();
+
+    for (RenderFrame& frame : game.render_frames) {
+        destroy_offscreen_buffer(&frame.buffer);
+        frame.buffer = create_offscreen_buffer(width, height);
+        if (!frame.buffer.memory) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// The texture is the backbuffer's size and made once. Window resizes only
+// change how the renderer scales it, so they never touch the texture.
+fn create_backbuffer(i32 width, i32 height) -> bool {
+    if (!resize_backbuffers(width, height)) {
+        return false;
     }
 
     game.texture = SDL_CreateTexture(
@@ -125,294 +235,450 @@ fn resize_texture(i32 width, i32 height) -> bool {
         return false;
     }
 
-    SDL_SetTextureScaleMode(game.texture, SDL_SCALEMODE_NEAREST);
+    SDL_SetTextureScaleMode(
+        game.texture,
+        game.integer_scale ? SDL_SCALEMODE_NEAREST : SDL_SCALEMODE_LINEAR
+    );
+
+    if (!SDL_SetRenderLogicalPresentation(
+            game.renderer,
+            width,
+            height,
+            game.integer_scale ? SDL_LOGICAL_PRESENTATION_INTEGER_SCALE
+                               : SDL_LOGICAL_PRESENTATION_LETTERBOX
+        )) {
+        SDL_Log("Unable to scale the backbuffer: %s", SDL_GetError());
+        return false;
+    }
 
     return true;
 }
 
-fn render_weird_gradient(GameState* state) -> void {
-    if (!game.texture)
-        return;
+fn game_update_stub(
+    [[maybe_unused]] GameMemory* memory,
+    [[maybe_unused]] GameInput* input
+) -> bool {
+    return true;
+}
 
-    void* pixels = nullptr;
-    i32 pitch = 0;
+fn game_render_stub(
+    [[maybe_unused]] GameMemory* memory,
+    [[maybe_unused]] RenderCommands* commands
+) -> void {}
 
-    if (!SDL_LockTexture(game.texture, nullptr, &pixels, &pitch)) {
-        SDL_Log("You are a failure. %s", SDL_GetError());
-        return;
+static fn game_get_sound_samples_stub(
+    [[maybe_unused]] Mixer* mixer,
+    f32* samples,
+    u32 sample_count
+) -> void {
+    memset(samples, 0, sample_count * sizeof(f32));
+}
+
+fn library_write_time(const char* path) -> SDL_Time {
+    SDL_PathInfo info;
+    if (!SDL_GetPathInfo(path, &info))
+        return 0;
+
+    return info.modify_time;
+}
+
+fn unload_game_code(GameCode* code) -> void {
+    if (code->library) {
+        SDL_UnloadObject(code->library);
+        SDL_RemovePath(code->loaded_path);
+        code->library = nullptr;
     }
 
-    f32 texture_width, texture_height;
-    if (!SDL_GetTextureSize(game.texture, &texture_width, &texture_height)) {
-        SDL_UnlockTexture(game.texture);
-        return;
+    code->update = game_update_stub;
+    code->render = game_render_stub;
+    code->get_sound_samples = game_get_sound_samples_stub;
+}
+
+fn load_game_code(GameCode* code) -> bool {
+    const char* base_path = SDL_GetBasePath();
+    if (!base_path) {
+        base_path = "";
     }
 
-    u8* row = (u8*)pixels;
+    SDL_snprintf(
+        code->source_path,
+        sizeof(code->source_path),
+        "%s%s%s",
+        base_path,
+        GAME_LIBRARY_NAME,
+        GAME_LIBRARY_EXTENSION
+    );
+    SDL_snprintf(
+        code->lock_path,
+        sizeof(code->lock_path),
+        "%slock.tmp",
+        base_path
+    );
+    // A new name every load: some loaders hand back the old, still-mapped
+    // library when asked for a path they have seen before.
+    SDL_snprintf(
+        code->loaded_path,
+        sizeof(code->loaded_path),
+        "%s%s_loaded_%u%s",
+        base_path,
+        GAME_LIBRARY_NAME,
+        code->load_count++,
+        GAME_LIBRARY_EXTENSION
+    );
 
-    for (i32 y = 0; y < (i32)texture_height; ++y) {
-        u32* pixel = (u32*)row;
+    code->last_write_time = library_write_time(code->source_path);
 
-        for (i32 x = 0; x < (i32)texture_width; ++x) {
-            u8 blue = (x + state->blue_offset);
-            u8 green = (y + state->green_offset);
+    if (!SDL_CopyFile(code->source_path, code->loaded_path)) {
+        SDL_Log(
+            "Failed to copy %s: %s",
+            code->source_path,
+            SDL_GetError()
+        );
+        unload_game_code(code);
+        return false;
+    }
 
-            *pixel++ = ((green << 8) | blue);
-        }
+    code->library = SDL_LoadObject(code->loaded_path);
+    if (!code->library) {
+        SDL_Log("Failed to load game code: %s", SDL_GetError());
+        SDL_RemovePath(code->loaded_path);
+        unload_game_code(code);
+        return false;
+    }
+
+    code->update =
+        (GameUpdate*)SDL_LoadFunction(code->library, "game_update");
+    code->render =
+        (GameRender*)SDL_LoadFunction(code->library, "game_render");
+    code->get_sound_samples = (GameGetSoundSamples*)SDL_LoadFunction(
+        code->library,
+        "game_get_sound_samples"
+    );
 
-        row += pitch;
+    if (!code->update || !code->render || !code->get_sound_samples) {
+        SDL_Log("Game code is missing exports: %s", SDL_GetError());
+        unload_game_code(code);
+        return false;
     }
 
-    SDL_UnlockTexture(game.texture);
+    return true;
 }
 
-fn handle_input(
-    GameInput* prev_input,
-    GameInput* curr_input,
-    [[maybe_unused]] GameState* state
-) -> void {
-    // Copy old input
-    *curr_input = *prev_input;
+// The build writes lock.tmp while it is still producing the library, so a
+// change only counts once that is gone.
+fn game_code_changed(GameCode* code) -> bool {
+    if (SDL_GetPathInfo(code->lock_path, nullptr))
+        return false;
 
-    // Clear transition counts for new frame
-    for (i32 controller_index = 0; controller_index < 5; ++controller_index) {
-        GameControllerInput* controller =
-            &curr_input->controllers[controller_index];
-        for (i32 button_index = 0; button_index < 12; ++button_index) {
-            controller->buttons[button_index].half_transition_count = 0;
-        }
+    SDL_Time write_time = library_write_time(code->source_path);
+    return write_time && write_time != code->last_write_time;
+}
+
+// Only called between frames, so the main thread isn't inside the old code.
+// A frame still being rasterized doesn't need it either, since render commands
+// hold no pointers into game code, and holding the stream lock keeps the audio
+// callback out while the library is swapped.
+fn reload_game_code() -> void {
+    u64 start_ns = SDL_GetTicksNS();
+
+    SDL_AudioStream* stream = game.sound.audio_stream;
+    if (stream) {
+        SDL_LockAudioStream(stream);
     }
 
-    GameControllerInput* keyboard_input_prev = &prev_input->keyboard_input;
-    GameControllerInput* keyboard_input = &curr_input->keyboard_input;
-    keyboard_input->is_connected = true;
-    keyboard_input->is_analog = false;
+    // The render workers are the only other threads recording profile
+    // events; the game's call sites can't be retired under them.
+    complete_all_work(&game.render_queue);
+    PROFILE_RETIRE_CALL_SITES(GAME_PROFILE_CALL_SITE_BASE);
 
-    const bool* keyboard_state = SDL_GetKeyboardState(nullptr);
+    unload_game_code(&game.code);
+    load_game_code(&game.code);
+    game.sound.mixer.fill = game.code.get_sound_samples;
 
-    keyboard_input->move_up.process_button_state(
-        &keyboard_input_prev->move_up,
-        keyboard_state[SDL_SCANCODE_W]
-    );
+    if (stream) {
+        SDL_UnlockAudioStream(stream);
+    }
 
-    keyboard_input->move_down.process_button_state(
-        &keyboard_input_prev->move_down,
-        keyboard_state[SDL_SCANCODE_S]
+    SDL_Log(
+        "Reloaded game code in %.2f ms",
+        (SDL_GetTicksNS() - start_ns) / 1000000.0
     );
+}
 
-    keyboard_input->move_left.process_button_state(
-        &keyboard_input_prev->move_left,
-        keyboard_state[SDL_SCANCODE_A]
-    );
+fn update_texture(OffscreenBuffer* buffer, SDL_Rect* rects, i32 rect_count)
+    -> void {
+    if (!game.texture)
+        return;
 
-    keyboard_input->move_right.process_button_state(
-        &keyboard_input_prev->move_right,
-        keyboard_state[SDL_SCANCODE_D]
-    );
+    for (i32 i = 0; i < rect_count; ++i) {
+        SDL_Rect* rect = &rects[i];
+        u8* pixels = buffer->memory + rect->y * buffer->pitch +
+                     rect->x * (i32)sizeof(u32);
 
-    keyboard_input->action_up.process_button_state(
-        &keyboard_input_prev->action_up,
-        keyboard_state[SDL_SCANCODE_UP]
-    );
+        if (!SDL_UpdateTexture(game.texture, rect, pixels, buffer->pitch)) {
+            SDL_Log("You are a failure. %s", SDL_GetError());
+            return;
+        }
+    }
+}
 
-    keyboard_input->action_down.process_button_state(
-        &keyboard_input_prev->action_down,
-        keyboard_state[SDL_SCANCODE_DOWN]
-    );
+struct KeyBinding {
+    SDL_Scancode scancode;
+    GameButton button;
+};
 
-    keyboard_input->action_left.process_button_state(
-        &keyboard_input_prev->action_left,
-        keyboard_state[SDL_SCANCODE_LEFT]
-    );
+struct GamepadBinding {
+    SDL_GamepadButton gamepad_button;
+    GameButton button;
+};
 
-    keyboard_input->action_right.process_button_state(
-        &keyboard_input_prev->action_right,
-        keyboard_state[SDL_SCANCODE_RIGHT]
-    );
+constexpr KeyBinding KEY_BINDINGS[] = {
+    {SDL_SCANCODE_W, ButtonMoveUp},
+    {SDL_SCANCODE_S, ButtonMoveDown},
+    {SDL_SCANCODE_A, ButtonMoveLeft},
+    {SDL_SCANCODE_D, ButtonMoveRight},
+    {SDL_SCANCODE_UP, ButtonActionUp},
+    {SDL_SCANCODE_DOWN, ButtonActionDown},
+    {SDL_SCANCODE_LEFT, ButtonActionLeft},
+    {SDL_SCANCODE_RIGHT, ButtonActionRight},
+    {SDL_SCANCODE_M, ButtonMute},
+    {SDL_SCANCODE_U, ButtonUnmute},
+    {SDL_SCANCODE_ESCAPE, ButtonStart},
+};
 
-    keyboard_input->start.process_button_state(
-        &keyboard_input_prev->start,
-        keyboard_state[SDL_SCANCODE_ESCAPE]
-    );
+constexpr GamepadBinding GAMEPAD_BINDINGS[] = {
+    {SDL_GAMEPAD_BUTTON_DPAD_UP, ButtonMoveUp},
+    {SDL_GAMEPAD_BUTTON_DPAD_DOWN, ButtonMoveDown},
+    {SDL_GAMEPAD_BUTTON_DPAD_LEFT, ButtonMoveLeft},
+    {SDL_GAMEPAD_BUTTON_DPAD_RIGHT, ButtonMoveRight},
+    {SDL_GAMEPAD_BUTTON_NORTH, ButtonActionUp},
+    {SDL_GAMEPAD_BUTTON_SOUTH, ButtonActionDown},
+    {SDL_GAMEPAD_BUTTON_WEST, ButtonActionLeft},
+    {SDL_GAMEPAD_BUTTON_EAST, ButtonActionRight},
+    {SDL_GAMEPAD_BUTTON_LEFT_SHOULDER, ButtonLeftShoulder},
+    {SDL_GAMEPAD_BUTTON_RIGHT_SHOULDER, ButtonRightShoulder},
+    {SDL_GAMEPAD_BUTTON_BACK, ButtonBack},
+    {SDL_GAMEPAD_BUTTON_START, ButtonStart},
+};
 
-    keyboard_input->start.process_button_state(
-        &keyboard_input_prev->start,
-        keyboard_state[SDL_SCANCODE_ESCAPE]
-    );
+// The slot holding the gamepad with this id, or -1. An id of 0, which SDL
+// never hands out, finds the first free slot.
+fn find_gamepad_slot(SDL_JoystickID id) -> i32 {
+    for (i32 slot = 0; slot < (i32)MAX_GAMEPADS; ++slot) {
+        SDL_Gamepad* gamepad = game.gamepads[slot];
+        if (gamepad ? SDL_GetGamepadID(gamepad) == id : id == 0) {
+            return slot;
+        }
+    }
 
-    // TODO: Handle the other controllers
-    if (game.input.controller_connected && game.input.gamepad) {
-        GameControllerInput* gamepad_controller_prev =
-            &prev_input->controller_input0;
-        GameControllerInput* gamepad_controller =
-            &curr_input->controller_input0;
-        gamepad_controller->is_connected = true;
-        gamepad_controller->is_analog = true;
-
-        gamepad_controller->move_up.process_button_state(
-            &gamepad_controller_prev->move_up,
-            SDL_GetGamepadButton(game.input.gamepad, SDL_GAMEPAD_BUTTON_DPAD_UP)
-        );
+    return -1;
+}
 
-        gamepad_controller->move_down.process_button_state(
-            &gamepad_controller_prev->move_down,
-            SDL_GetGamepadButton(
-                game.input.gamepad,
-                SDL_GAMEPAD_BUTTON_DPAD_DOWN
-            )
-        );
+fn open_gamepad(SDL_JoystickID id) -> void {
+    if (find_gamepad_slot(id) >= 0)
+        return;
 
-        gamepad_controller->move_left.process_button_state(
-            &gamepad_controller_prev->move_left,
-            SDL_GetGamepadButton(
-                game.input.gamepad,
-                SDL_GAMEPAD_BUTTON_DPAD_LEFT
-            )
-        );
+    i32 slot = find_gamepad_slot(0);
+    if (slot < 0) {
+        SDL_Log("Ignoring controller: all %u slots are taken", MAX_GAMEPADS);
+        return;
+    }
 
-        gamepad_controller->move_right.process_button_state(
-            &gamepad_controller_prev->move_right,
-            SDL_GetGamepadButton(
-                game.input.gamepad,
-                SDL_GAMEPAD_BUTTON_DPAD_RIGHT
-            )
-        );
+    SDL_Gamepad* gamepad = SDL_OpenGamepad(id);
+    if (!gamepad) {
+        SDL_Log("Unable to open controller: %s", SDL_GetError());
+        return;
+    }
 
-        gamepad_controller->action_up.process_button_state(
-            &gamepad_controller_prev->action_up,
-            SDL_GetGamepadButton(game.input.gamepad, SDL_GAMEPAD_BUTTON_NORTH)
-        );
+    const char* name = SDL_GetGamepadName(gamepad);
+    SDL_Log("Controller %d connected: %s", slot + 1, name ? name : "Unknown");
+    game.gamepads[slot] = gamepad;
+}
 
-        gamepad_controller->action_down.process_button_state(
-            &gamepad_controller_prev->action_down,
-            SDL_GetGamepadButton(game.input.gamepad, SDL_GAMEPAD_BUTTON_SOUTH)
-        );
+fn close_gamepad(SDL_JoystickID id) -> void {
+    i32 slot = find_gamepad_slot(id);
+    if (slot < 0)
+        return;
 
-        gamepad_controller->action_left.process_button_state(
-            &gamepad_controller_prev->action_left,
-            SDL_GetGamepadButton(game.input.gamepad, SDL_GAMEPAD_BUTTON_WEST)
-        );
+    SDL_CloseGamepad(game.gamepads[slot]);
+    game.gamepads[slot] = nullptr;
+    SDL_Log("Controller %d disconnected", slot + 1);
+}
 
-        gamepad_controller->action_right.process_button_state(
-            &gamepad_controller_prev->action_right,
-            SDL_GetGamepadButton(game.input.gamepad, SDL_GAMEPAD_BUTTON_EAST)
-        );
+// Holds a press or release until the next handle_input. Should the queue
+// fill, the oldest events stay and the rest are dropped.
+fn queue_input_event(
+    u64 timestamp_ns,
+    u8 controller_index,
+    GameButton button,
+    bool is_down
+) -> void {
+    if (game.pending_input_count == SDL_arraysize(game.pending_input)) {
+        SDL_Log("Input event queue is full");
+        return;
+    }
 
-        gamepad_controller->left_shoulder.process_button_state(
-            &gamepad_controller_prev->left_shoulder,
-            SDL_GetGamepadButton(
-                game.input.gamepad,
-                SDL_GAMEPAD_BUTTON_LEFT_SHOULDER
-            )
-        );
+    game.pending_input[game.pending_input_count++] = InputEvent{
+        .timestamp_ns = timestamp_ns,
+        .controller_index = controller_index,
+        .button = button,
+        .is_down = is_down,
+    };
+}
 
-        gamepad_controller->right_shoulder.process_button_state(
-            &gamepad_controller_prev->right_shoulder,
-            SDL_GetGamepadButton(
-                game.input.gamepad,
-                SDL_GAMEPAD_BUTTON_RIGHT_SHOULDER
-            )
-        );
+// Folds the presses and releases queued since the last frame into
+// curr_input, in the order they happened, on top of prev_input's states.
+fn handle_input(GameInput* prev_input, GameInput* curr_input) -> void {
+    TIMED_BLOCK("handle_input");
 
-        gamepad_controller->start.process_button_state(
-            &gamepad_controller_prev->start,
-            SDL_GetGamepadButton(game.input.gamepad, SDL_GAMEPAD_BUTTON_START)
-        );
+    curr_input->event_count = 0;
+    for (u32 i = 0; i < MAX_CONTROLLERS; ++i) {
+        curr_input->controllers[i] = prev_input->controllers[i];
+        curr_input->controllers[i].pressed = 0;
+        curr_input->controllers[i].released = 0;
+    }
 
-        i16 left_x =
-            SDL_GetGamepadAxis(game.input.gamepad, SDL_GAMEPAD_AXIS_LEFTX);
-        i16 left_y =
-            SDL_GetGamepadAxis(game.input.gamepad, SDL_GAMEPAD_AXIS_LEFTY);
-        [[maybe_unused]] i16 right_x =
-            SDL_GetGamepadAxis(game.input.gamepad, SDL_GAMEPAD_AXIS_RIGHTX);
-        [[maybe_unused]] i16 right_y =
-            SDL_GetGamepadAxis(game.input.gamepad, SDL_GAMEPAD_AXIS_RIGHTY);
+    GameControllerInput* keyboard_input = &curr_input->keyboard_input;
+    keyboard_input->is_connected = true;
+    keyboard_input->is_analog = false;
 
-        if (abs(left_x) > DEADZONE || abs(left_y) > DEADZONE) {
-            gamepad_controller->stick_average_x = left_x / 32767.0f;
-            gamepad_controller->stick_average_y = left_y / 32767.0f;
-        } else {
-            gamepad_controller->stick_average_x = 0.0f;
-            gamepad_controller->stick_average_y = 0.0f;
+    for (u32 i = 0; i < game.pending_input_count; ++i) {
+        InputEvent* event = &game.pending_input[i];
+        GameControllerInput* controller =
+            &curr_input->controllers[event->controller_index];
+        controller->process_transition(
+            (GameButton)event->button,
+            event->is_down
+        );
+
+        if (curr_input->event_count < MAX_INPUT_EVENTS) {
+            curr_input->events[curr_input->event_count++] = *event;
         }
     }
-}
+    game.pending_input_count = 0;
 
-fn update(GameInput* input, GameState* state) -> void {
-    for (i32 controller_index = 0; controller_index < 5; ++controller_index) {
-        GameControllerInput* controller = &input->controllers[controller_index];
+    // Latency is measured from the oldest input the frame reacts to.
+    game.input_ns =
+        curr_input->event_count ? curr_input->events[0].timestamp_ns : 0;
 
-        if (!controller->is_connected)
+    for (u32 slot = 0; slot < MAX_GAMEPADS; ++slot) {
+        SDL_Gamepad* gamepad = game.gamepads[slot];
+        GameControllerInput* controller = &curr_input->gamepads[slot];
+        if (!gamepad) {
+            *controller = {};
             continue;
-
-        f32 move_x = 0.0f;
-        f32 move_y = 0.0f;
-
-        if (controller->is_analog) {
-            move_x = controller->stick_average_x;
-            move_y = controller->stick_average_y;
         }
 
-        if (controller->move_left.ended_down)
-            move_x = -1.0f;
-        if (controller->move_right.ended_down)
-            move_x = 1.0f;
-        if (controller->move_up.ended_down)
-            move_y = -1.0f;
-        if (controller->move_down.ended_down)
-            move_y = 1.0f;
+        controller->is_connected = true;
+        controller->is_analog = true;
 
-        state->blue_offset += (i32)(move_x * STEP_SIZE * 5.0f);
-        state->green_offset += (i32)(move_y * STEP_SIZE * 5.0f);
+        // Sticks are read as they are now; only buttons go through events.
+        i16 left_x = SDL_GetGamepadAxis(gamepad, SDL_GAMEPAD_AXIS_LEFTX);
+        i16 left_y = SDL_GetGamepadAxis(gamepad, SDL_GAMEPAD_AXIS_LEFTY);
 
-        if (controller->action_up.ended_down) {
-            state->tone_hz += 10.0f;
-            if (state->tone_hz > 2000.0f)
-                state->tone_hz = 2000.0f;
+        if (abs(left_x) > DEADZONE || abs(left_y) > DEADZONE) {
+            controller->stick_average_x = left_x / 32767.0f;
+            controller->stick_average_y = left_y / 32767.0f;
+        } else {
+            controller->stick_average_x = 0.0f;
+            controller->stick_average_y = 0.0f;
         }
+    }
+}
 
-        if (controller->action_down.ended_down) {
-            state->tone_hz -= 10.0f;
-            if (state->tone_hz < 100.0f)
-                state->tone_hz = 100.0f;
-        }
+// L cycles from live input to recording, to looping playback of that
+// recording, and back to live input.
+fn toggle_input_recording() -> void {
+    InputRecorder* recorder = &game.recorder;
 
-        if (controller->start.was_pressed()) {
-            game.running = false;
+    switch (recorder->mode) {
+        case InputRecordingIdle: {
+            begin_recording(recorder, &game.memory, INPUT_RECORDING_FILE);
+            break;
         }
 
-        if (controller->action_right.was_pressed()) {
-            if (state->preset_tones_idx + 1 >= TONES_LEN) {
-                state->preset_tones_idx = 0;
-            } else {
-                state->preset_tones_idx += 1;
-            }
-
-            state->tone_hz = TONES[state->preset_tones_idx];
+        case InputRecordingRecording: {
+            end_recording(recorder);
+            begin_playback(recorder, &game.memory, INPUT_RECORDING_FILE);
+            break;
         }
 
-        if (controller->action_left.was_pressed()) {
-            if (state->preset_tones_idx == 0) {
-                state->preset_tones_idx = TONES_LEN - 1;
-            } else {
-                state->preset_tones_idx -= 1;
-            }
+        case InputRecordingPlayingBack: {
+            end_playback(recorder);
+            break;
+        }
+    }
+}
 
-            state->tone_hz = TONES[state->preset_tones_idx];
+// Replaces this frame's live input with the recorded frame, if playing back.
+fn apply_input_recording(GameInput* input) -> void {
+    InputRecorder* recorder = &game.recorder;
+
+    if (recorder->mode == InputRecordingPlayingBack) {
+        if (!playback_input(
+                recorder,
+                &game.memory,
+                input,
+                &game.expected_state_hash
+            )) {
+            SDL_Log("Nothing recorded, back to live input");
+            end_playback(recorder);
         }
+    }
+}
 
-        const bool* keyboard_state = SDL_GetKeyboardState(nullptr);
-        if (keyboard_state[SDL_SCANCODE_M]) {
-            game.sound.tone_volume = 0.0;
+fn log_state_divergence(u64 frame, u64 expected_hash, u64 actual_hash)
+    -> void {
+    SDL_Log(
+        "Frame %" SDL_PRIu64 " diverged from the recording: "
+        "state hash %016" SDL_PRIx64 ", recorded %016" SDL_PRIx64,
+        frame,
+        actual_hash,
+        expected_hash
+    );
+}
+
+// After the update: records the frame's input with the state it left, or in
+// deterministic mode checks that state against the recording. Only the first
+// divergence in each pass is logged; everything after it follows from it.
+fn end_recorded_frame(GameInput* input) -> void {
+    InputRecorder* recorder = &game.recorder;
+
+    if (recorder->mode == InputRecordingRecording) {
+        record_input(recorder, input, hash_game_state(&game.memory));
+    } else if (recorder->mode == InputRecordingPlayingBack &&
+               game.deterministic) {
+        if (recorder->frame_count == 1) {
+            game.state_diverged = false;
         }
 
-        if (keyboard_state[SDL_SCANCODE_U]) {
-            game.sound.tone_volume = 0.1;
+        u64 state_hash = hash_game_state(&game.memory);
+        if (!game.state_diverged && state_hash != game.expected_state_hash) {
+            log_state_divergence(
+                recorder->frame_count,
+                game.expected_state_hash,
+                state_hash
+            );
+            game.state_diverged = true;
         }
     }
 }
 
-fn handle_window_events([[maybe_unused]] GameState* state) -> void {
+fn display_refresh_hz() -> f32 {
+    if (!game.window)
+        return DEFAULT_REFRESH_HZ;
+
+    const SDL_DisplayMode* mode =
+        SDL_GetCurrentDisplayMode(SDL_GetDisplayForWindow(game.window));
+    if (!mode || mode->refresh_rate <= 0.0f)
+        return DEFAULT_REFRESH_HZ;
+
+    return mode->refresh_rate;
+}
+
+fn handle_window_events() -> void {
+    TIMED_BLOCK("handle_window_events");
+
     SDL_Event event;
 
     while (SDL_PollEvent(&event)) {
@@ -426,8 +692,24 @@ fn handle_window_events([[maybe_unused]] GameState* state) -> void {
                 game.win_width = event.window.data1;
                 game.win_height = event.window.data2;
 
-                resize_texture(game.win_width, game.win_height);
+                // The backbuffer keeps its size and pixels; it only has to
+                // be shown again at the new scale.
+                game.needs_present = true;
+                break;
+            }
+
+            case SDL_EVENT_WINDOW_DISPLAY_CHANGED: {
+                if (!game.deterministic) {
+                    set_frame_scheduler_rate(
+                        &game.scheduler,
+                        display_refresh_hz()
+                    );
+                }
+                break;
+            }
 
+            case SDL_EVENT_WINDOW_EXPOSED: {
+                game.needs_present = true;
                 break;
             }
 
@@ -441,121 +723,240 @@ fn handle_window_events([[maybe_unused]] GameState* state) -> void {
                 break;
             }
 
-            case SDL_EVENT_GAMEPAD_ADDED: {
-                if (!game.input.controller_connected) {
-                    game.input.gamepad = SDL_OpenGamepad(event.gdevice.which);
-                    if (game.input.gamepad) {
-                        game.input.controller_connected = true;
-                        const char* name =
-                            SDL_GetGamepadName(game.input.gamepad);
-                        SDL_Log(
-                            "Controller connected: %s",
-                            name ? name : "Unknown"
+            case SDL_EVENT_KEY_DOWN:
+            case SDL_EVENT_KEY_UP: {
+                if (event.key.repeat)
+                    break;
+
+                if (event.key.down && event.key.key == SDLK_L) {
+                    toggle_input_recording();
+                }
+
+                for (const KeyBinding& binding : KEY_BINDINGS) {
+                    if (binding.scancode == event.key.scancode) {
+                        queue_input_event(
+                            event.key.timestamp,
+                            KEYBOARD_CONTROLLER_INDEX,
+                            binding.button,
+                            event.key.down
                         );
                     }
                 }
                 break;
             }
 
-            case SDL_EVENT_GAMEPAD_REMOVED: {
-                if (game.input.gamepad &&
-                    event.gdevice.which ==
-                        SDL_GetGamepadID(game.input.gamepad)) {
-                    SDL_CloseGamepad(game.input.gamepad);
-                    game.input.gamepad = nullptr;
-                    game.input.controller_connected = false;
-                    SDL_Log("Controller disconnected");
+            case SDL_EVENT_GAMEPAD_BUTTON_DOWN:
+            case SDL_EVENT_GAMEPAD_BUTTON_UP: {
+                i32 slot = find_gamepad_slot(event.gbutton.which);
+                if (slot < 0)
+                    break;
+
+                for (const GamepadBinding& binding : GAMEPAD_BINDINGS) {
+                    if (binding.gamepad_button == event.gbutton.button) {
+                        queue_input_event(
+                            event.gbutton.timestamp,
+                            (u8)(FIRST_GAMEPAD_CONTROLLER_INDEX + slot),
+                            binding.button,
+                            event.gbutton.down
+                        );
+                    }
                 }
                 break;
             }
-        }
-    }
-}
 
-fn handle_audio_stream(GameState* state) -> void {
-    if (!game.sound.audio_stream)
-        return;
+            case SDL_EVENT_GAMEPAD_ADDED: {
+                open_gamepad(event.gdevice.which);
+                break;
+            }
 
-    // Target ~100 ms of queued audio to avoid underruns.
-    constexpr f32 TARGET_SECONDS = 0.10;
-    constexpr usize SAMPLE_COUNT = 512;
-
-    f32 samples[SAMPLE_COUNT];
-    i32 target_bytes = (i32)(SAMPLE_RATE * sizeof(f32) * TARGET_SECONDS);
-
-    // See if we need to feed the audio stream more data yet.
-    // We're being lazy here, but if there's less than half a second queued,
-    // generate more. A sine wave is unchanging audio--easy to stream--but for
-    // video games, you'll want to generate significantly _less_ audio ahead of
-    // time!
-    if (SDL_GetAudioStreamQueued(game.sound.audio_stream) < target_bytes) {
-        // Generate a 440hz pure tone
-        for (u32 i = 0; i < SAMPLE_COUNT; i++) {
-            f32 sine_value = SDL_sinf(game.sound.wave_period * 2.0f * SDL_PI_F);
-            samples[i] = sine_value * game.sound.tone_volume;
-
-            // Advance the wave period by the frequency step
-            // This is the key insight from Casey's explanation:
-            // Each sample advances the phase by (frequency / sample_rate)
-            game.sound.wave_period += state->tone_hz / SAMPLE_RATE;
-
-            // Keep wave_period in a reasonable range to avoid floating point
-            // errors Since sine is periodic, we can wrap around at 1.0
-            if (game.sound.wave_period >= 1.0f) {
-                game.sound.wave_period -= 1.0f;
+            case SDL_EVENT_GAMEPAD_REMOVED: {
+                close_gamepad(event.gdevice.which);
+                break;
             }
         }
+    }
+}
 
-        SDL_PutAudioStreamData(
-            game.sound.audio_stream,
-            samples,
-            sizeof(samples)
+fn report_audio_underruns() -> void {
+    GameSound* sound = &game.sound;
+
+    i32 underruns = SDL_GetAtomicInt(&sound->mixer.underrun_count);
+    if (underruns != sound->reported_underruns) {
+        SDL_LogDebug(
+            SDL_LOG_CATEGORY_AUDIO,
+            "Audio underruns: %d over %d callbacks",
+            underruns,
+            SDL_GetAtomicInt(&sound->mixer.callback_count)
         );
+        sound->reported_underruns = underruns;
     }
 }
 
-fn render(GameState* state) -> void {
-    if (!game.win_focused)
+// Frames with no input pass 0 for input_ns.
+fn record_present_timings(
+    PresentTimings* timings,
+    u64 input_ns,
+    u64 upload_ns,
+    u64 present_ns
+) -> void {
+    u64 now_ns = SDL_GetTicksNS();
+
+    timings->frame_count += 1;
+    if (input_ns) {
+        u64 latency_ns = now_ns - input_ns;
+        timings->input_frame_count += 1;
+        timings->total_latency_ns += latency_ns;
+        timings->max_latency_ns = SDL_max(timings->max_latency_ns, latency_ns);
+    }
+    timings->total_upload_ns += upload_ns;
+    timings->max_upload_ns = SDL_max(timings->max_upload_ns, upload_ns);
+    timings->total_present_ns += present_ns;
+    timings->max_present_ns = SDL_max(timings->max_present_ns, present_ns);
+
+    if (now_ns - timings->last_report_ns < SDL_NS_PER_SECOND)
         return;
 
-    render_weird_gradient(state);
+    f64 frame_count = (f64)timings->frame_count;
+    f64 input_frame_count = (f64)SDL_max(timings->input_frame_count, 1);
+    SDL_LogDebug(
+        SDL_LOG_CATEGORY_RENDER,
+        "Present: input to present avg %.2f ms, max %.2f ms over %llu "
+        "frames; upload avg %.2f ms, max %.2f ms; "
+        "present avg %.2f ms, max %.2f ms",
+        timings->total_latency_ns / input_frame_count / 1000000.0,
+        timings->max_latency_ns / 1000000.0,
+        (unsigned long long)timings->input_frame_count,
+        timings->total_upload_ns / frame_count / 1000000.0,
+        timings->max_upload_ns / 1000000.0,
+        timings->total_present_ns / frame_count / 1000000.0,
+        timings->max_present_ns / 1000000.0
+    );
+
+    *timings = {};
+    timings->last_report_ns = now_ns;
+}
+
+// Uploads the tiles of frame's backbuffer that differ from the texture and
+// shows them. Returns false, having done neither, when nothing on screen
+// changed.
+fn present(RenderFrame* frame) -> bool {
+    TIMED_BLOCK("present");
+
+    SDL_Rect rects[MAX_DAMAGE_RECTS];
+    i32 rect_count = take_damage_rects(
+        &frame->damage,
+        &game.texture_damage,
+        rects,
+        MAX_DAMAGE_RECTS
+    );
+    if (rect_count == 0 && !game.needs_present)
+        return false;
 
+    u64 upload_start_ns = SDL_GetTicksNS();
+    update_texture(&frame->buffer, rects, rect_count);
+    game.needs_present = false;
+
+    u64 present_start_ns = SDL_GetTicksNS();
     SDL_SetRenderDrawColor(game.renderer, 0, 0, 0, 255);
     SDL_RenderClear(game.renderer);
     if (game.texture) {
         SDL_RenderTexture(game.renderer, game.texture, nullptr, nullptr);
     }
     SDL_RenderPresent(game.renderer);
+
+    u64 end_ns = SDL_GetTicksNS();
+    record_present_timings(
+        &game.present_timings,
+        frame->input_ns,
+        present_start_ns - upload_start_ns,
+        end_ns - present_start_ns
+    );
+
+    return true;
+}
+
+// Has the game describe this frame, then hands it to the render queue as soon
+// as the previous one is drawn, and presents the previous one while the queue
+// draws this one and, after that, while the next update runs.
+fn render() -> void {
+    TIMED_BLOCK("render");
+
+    game.presented = false;
+    if (!game.headless && !game.win_focused) {
+        finish_rendering();
+        return;
+    }
+
+    RenderFrame* frame = &game.render_frames[game.next_render_frame];
+    game.next_render_frame = (game.next_render_frame + 1) % RENDER_FRAME_COUNT;
+
+    frame->arena.reset();
+    frame->input_ns = game.input_ns;
+    frame->commands = RenderCommands{
+        .width = frame->buffer.width,
+        .height = frame->buffer.height,
+        .base = (u8*)frame->arena.alloc_bytes(RENDER_COMMAND_BUFFER_SIZE, 64),
+        .capacity = RENDER_COMMAND_BUFFER_SIZE,
+        .used = 0,
+        .command_count = 0,
+    };
+    if (!frame->commands.base) {
+        frame->commands.capacity = 0;
+    }
+    game.code.render(&game.memory, &frame->commands);
+
+    RenderFrame* drawn = finish_rendering();
+
+    if (begin_render_batch(
+            &frame->batch,
+            &game.render_queue,
+            &frame->arena,
+            &frame->commands,
+            &frame->buffer,
+            game.gradient_kernel->kernel,
+            &frame->damage
+        )) {
+        game.rendering = frame;
+    } else {
+        SDL_Log("Out of memory sorting render commands");
+        complete_all_work(&game.render_queue);
+        invalidate_render_damage(&frame->damage);
+    }
+
+    if (drawn && !game.headless) {
+        game.presented = present(drawn);
+    }
 }
 
-fn initialize_gamepad() -> void {
+// Opens every gamepad already plugged in. Ones plugged in later arrive as
+// SDL_EVENT_GAMEPAD_ADDED.
+fn initialize_gamepads() -> void {
     i32 n_joysticks;
     SDL_JoystickID* joysticks = SDL_GetJoysticks(&n_joysticks);
 
-    if (n_joysticks > 0) {
+    if (joysticks) {
         for (i32 i = 0; i < n_joysticks; i++) {
             if (SDL_IsGamepad(joysticks[i])) {
-                game.input.gamepad = SDL_OpenGamepad(joysticks[i]);
-                if (game.input.gamepad) {
-                    game.input.controller_connected = true;
-                    const char* name = SDL_GetGamepadName(game.input.gamepad);
-                    SDL_Log(
-                        "Controller connected: %s",
-                        name ? name : "Unknown"
-                    );
-                    break;
-                }
+                open_gamepad(joysticks[i]);
             }
         }
         SDL_free(joysticks);
     }
 
-    if (!game.input.controller_connected) {
+    // Slots fill from the first.
+    if (!game.gamepads[0]) {
         SDL_Log("No controller detected");
     }
 }
 
 fn initialize_audio() -> bool {
+    // Ask for a small device buffer; the mixer callback fills exactly what
+    // the device asks for, so this is most of the output latency.
+    SDL_SetHint(
+        SDL_HINT_AUDIO_DEVICE_SAMPLE_FRAMES,
+        AUDIO_DEVICE_SAMPLE_FRAMES
+    );
+
     SDL_AudioSpec spec = {};
     spec.format = SDL_AUDIO_F32;
     spec.channels = 1;
@@ -564,59 +965,286 @@ fn initialize_audio() -> bool {
     game.sound.audio_stream = SDL_OpenAudioDeviceStream(
         SDL_AUDIO_DEVICE_DEFAULT_PLAYBACK,
         &spec,
-        nullptr,
-        nullptr
+        mixer_audio_callback,
+        &game.sound.mixer
     );
     if (!game.sound.audio_stream) {
         SDL_Log("You will die in misery");
         return false;
     }
 
+    SDL_AudioSpec device_spec = {};
+    i32 device_sample_frames = 0;
+    if (SDL_GetAudioDeviceFormat(
+            SDL_GetAudioStreamDevice(game.sound.audio_stream),
+            &device_spec,
+            &device_sample_frames
+        )) {
+        SDL_Log(
+            "Audio device buffer: %d frames (%.2f ms)",
+            device_sample_frames,
+            device_sample_frames * 1000.0f / device_spec.freq
+        );
+    }
+
     SDL_ResumeAudioStreamDevice(game.sound.audio_stream);
 
     return true;
 }
 
-fn initialize() -> bool {
-    if (!SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_GAMEPAD)) {
-        SDL_Log("You've failed as a human being.");
+fn initialize_render_queue() -> bool {
+    // Every build checks, release and benchmark ones included: a kernel that
+    // disagrees with its scalar reference draws wrong pixels.
+    if (!verify_gradient_kernels() || !verify_raster_kernels()) {
         return false;
     }
+    game.gradient_kernel = select_gradient_kernel();
+    SDL_Log("Using %s gradient kernel", game.gradient_kernel->name);
 
-    SDL_CreateWindowAndRenderer(
-        "Handmade hero SDL3",
-        game.win_width,
-        game.win_height,
-        0,
-        &game.window,
-        &game.renderer
+    game.render_arena = FixedBufferAllocator::reserve(
+        RENDER_FRAME_ARENA_SIZE * RENDER_FRAME_COUNT
     );
-
-    if (!game.window || !game.renderer) {
-        SDL_Log("Maybe you should buy a new computer.");
+    if (!game.render_arena.memory) {
         return false;
     }
 
-    if (!SDL_SetRenderVSync(game.renderer, 1)) {
-        SDL_Log("Warning: Unable to enable VSync: %s", SDL_GetError());
+    for (RenderFrame& frame : game.render_frames) {
+        frame.arena = FixedBufferAllocator::create_from(
+            &game.render_arena,
+            RENDER_FRAME_ARENA_SIZE
+        );
+        if (!frame.arena.memory) {
+            return false;
+        }
     }
 
-    if (!resize_texture(game.win_width, game.win_height)) {
-        return false;
-    }
+    // The main thread works the queue too while it waits on the barrier.
+    i32 worker_count = SDL_GetNumLogicalCPUCores() - 1;
+    return init_work_queue(
+        &game.render_queue,
+        worker_count,
+        "render",
+        WORKER_SCRATCH_SIZE
+    );
+}
 
-    initialize_audio();
-    initialize_gamepad();
+// The game library can be unloaded while its loads are in flight, so the work
+// callback has to live out here rather than in the game's copy of the loader.
+fn platform_begin_async_load(
+    const char* filename,
+    FixedBufferAllocator* arena,
+    u64 user_data
+) -> bool {
+    return begin_async_load(&game.loader, filename, arena, user_data);
+}
 
-    return true;
+fn platform_poll_async_loads(AsyncLoadCompletion* completions, u32 max_count)
+    -> u32 {
+    return poll_async_loads(&game.loader, completions, max_count);
 }
 
-fn shutdown() -> void {
-    if (game.sound.audio_stream) {
-        SDL_DestroyAudioStream(game.sound.audio_stream);
+fn platform_begin_async_write(
+    const char* filename,
+    const void* data,
+    usize size,
+    u64 user_data
+) -> bool {
+    return begin_async_write(&game.writer, filename, data, size, user_data);
+}
+
+fn platform_poll_async_writes(AsyncWriteCompletion* completions, u32 max_count)
+    -> u32 {
+    return poll_async_writes(&game.writer, completions, max_count);
+}
+
+// A missing or broken pack isn't fatal: the game draws without its assets.
+fn open_assets() -> void {
+    char default_path[1024];
+    const char* path = game.assets_path;
+    if (!path) {
+        const char* base_path = SDL_GetBasePath();
+        SDL_snprintf(
+            default_path,
+            sizeof(default_path),
+            "%s%s",
+            base_path ? base_path : "",
+            DEFAULT_ASSET_PACK_NAME
+        );
+        path = default_path;
     }
-    if (game.input.gamepad) {
-        SDL_CloseGamepad(game.input.gamepad);
+
+    let pack = open_asset_pack(path, nullptr);
+    if (!pack) {
+        SDL_Log("Running without assets");
+        return;
+    }
+
+    game.assets = *pack;
+    SDL_Log("Loaded %u assets from %s", game.assets.asset_count, path);
+}
+
+// Runs before the audio device opens, so the first callback already goes
+// through the game library.
+fn initialize_game() -> bool {
+    u8* base_address = (u8*)GAME_MEMORY_BASE_ADDRESS;
+    game.memory.persistent_storage = FixedBufferAllocator::reserve(
+        PERSISTENT_STORAGE_SIZE,
+        base_address,
+        game.huge_pages
+    );
+    game.memory.transient_storage = FixedBufferAllocator::reserve(
+        TRANSIENT_STORAGE_SIZE,
+        base_address ? base_address + PERSISTENT_STORAGE_SIZE : nullptr,
+        game.huge_pages
+    );
+    game.memory.mixer = &game.sound.mixer;
+    game.memory.profiler = PROFILE_INSTANCE();
+    game.memory.assets = &game.assets;
+    game.memory.begin_async_load = platform_begin_async_load;
+    game.memory.poll_async_loads = platform_poll_async_loads;
+    game.memory.begin_async_write = platform_begin_async_write;
+    game.memory.poll_async_writes = platform_poll_async_writes;
+
+    if (!init_async_loader(&game.loader) || !init_async_writer(&game.writer)) {
+        return false;
+    }
+
+    open_assets();
+
+    if (!load_game_code(&game.code)) {
+        SDL_Log(
+            "Running without game code until %s is built",
+            game.code.source_path
+        );
+    }
+    game.sound.mixer.fill = game.code.get_sound_samples;
+
+    return init_input_recorder(
+        &game.recorder,
+        game.memory.persistent_storage.capacity
+    );
+}
+
+// No window, renderer or audio device: frames land in the backbuffers and go
+// no further.
+fn initialize_headless() -> bool {
+    if (!SDL_Init(SDL_INIT_EVENTS)) {
+        SDL_Log("You've failed as a human being.");
+        return false;
+    }
+
+    if (!resize_backbuffers(game.backbuffer_width, game.backbuffer_height)) {
+        return false;
+    }
+
+    init_frame_scheduler(&game.scheduler, DEFAULT_REFRESH_HZ);
+
+    return initialize_render_queue();
+}
+
+fn initialize() -> bool {
+    f32 sine_error = measure_synth_sine_error();
+    if (sine_error >= MAX_SYNTH_SINE_ERROR) {
+        SDL_Log(
+            "Synth sine is off by up to %g, past the %g allowed",
+            sine_error,
+            MAX_SYNTH_SINE_ERROR
+        );
+        return false;
+    }
+
+    init_mixer(
+        &game.sound.mixer,
+        game_get_sound_samples_stub,
+        SAMPLE_RATE,
+        440.0f,
+        0.1f
+    );
+
+    if (game.headless) {
+        return initialize_headless() && initialize_game();
+    }
+
+    if (!SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_GAMEPAD)) {
+        SDL_Log("You've failed as a human being.");
+        return false;
+    }
+
+    SDL_CreateWindowAndRenderer(
+        "Handmade hero SDL3",
+        game.win_width,
+        game.win_height,
+        SDL_WINDOW_RESIZABLE,
+        &game.window,
+        &game.renderer
+    );
+
+    if (!game.window || !game.renderer) {
+        SDL_Log("Maybe you should buy a new computer.");
+        return false;
+    }
+
+    game.vsync = SDL_SetRenderVSync(game.renderer, 1);
+    if (!game.vsync) {
+        SDL_Log("Warning: Unable to enable VSync: %s", SDL_GetError());
+    }
+
+    if (!create_backbuffer(game.backbuffer_width, game.backbuffer_height)) {
+        return false;
+    }
+
+    if (!initialize_render_queue()) {
+        return false;
+    }
+
+    if (!initialize_game()) {
+        return false;
+    }
+
+    initialize_audio();
+    initialize_gamepads();
+
+    init_frame_scheduler(
+        &game.scheduler,
+        game.deterministic ? DEFAULT_REFRESH_HZ : display_refresh_hz()
+    );
+    SDL_Log("Frame rate target: %.2f Hz", game.scheduler.refresh_hz);
+
+    return true;
+}
+
+fn shutdown() -> void {
+    finish_rendering();
+    shutdown_work_queue(&game.render_queue);
+    if (game.render_arena.memory) {
+        game.render_arena.destroy();
+    }
+    for (RenderFrame& frame : game.render_frames) {
+        if (frame.buffer.memory) {
+            destroy_offscreen_buffer(&frame.buffer);
+        }
+    }
+    if (game.sound.audio_stream) {
+        SDL_DestroyAudioStream(game.sound.audio_stream);
+        SDL_Log(
+            "Audio underruns: %d over %d callbacks",
+            SDL_GetAtomicInt(&game.sound.mixer.underrun_count),
+            SDL_GetAtomicInt(&game.sound.mixer.callback_count)
+        );
+    }
+    shutdown_async_loader(&game.loader);
+    shutdown_async_writer(&game.writer);
+    unload_game_code(&game.code);
+    close_asset_pack(&game.assets);
+    destroy_input_recorder(&game.recorder);
+    if (game.memory.persistent_storage.memory) {
+        game.memory.persistent_storage.destroy();
+        game.memory.transient_storage.destroy();
+    }
+    for (SDL_Gamepad* gamepad : game.gamepads) {
+        if (gamepad) {
+            SDL_CloseGamepad(gamepad);
+        }
     }
     if (game.texture) {
         SDL_DestroyTexture(game.texture);
@@ -631,37 +1259,1187 @@ fn shutdown() -> void {
     SDL_Quit();
 }
 
-int main([[maybe_unused]] int argc, [[maybe_unused]] char* argv[]) {
+struct BenchSize {
+    i32 width;
+    i32 height;
+};
+
+struct Options {
+    bool headless = false;
+    bool bench = false;
+    bool huge_pages = false;
+    i32 bench_frames = 600;
+    i32 bench_size_count = 0;
+    BenchSize bench_sizes[8] = {};
+    BenchSize backbuffer_size = {
+        DEFAULT_BACKBUFFER_WIDTH,
+        DEFAULT_BACKBUFFER_HEIGHT
+    };
+    bool integer_scale = false;
+    bool deterministic = false;
+    bool check_replay = false;
+    const char* bench_output = nullptr;
+    const char* profile_output = nullptr;
+    const char* record_path = nullptr;
+    const char* playback_path = nullptr;
+    const char* file_bench_path = nullptr;
+    const char* write_bench_path = nullptr;
+    const char* assets_path = nullptr;
+};
+
+// Parses "WxH" at *cursor and leaves *cursor just past it.
+fn parse_size(const char** cursor, BenchSize* size) -> bool {
+    char* end = nullptr;
+    i32 width = (i32)SDL_strtol(*cursor, &end, 10);
+    if (*end != 'x')
+        return false;
+    i32 height = (i32)SDL_strtol(end + 1, &end, 10);
+    if (width <= 0 || height <= 0)
+        return false;
+
+    *size = {width, height};
+    *cursor = end;
+    return true;
+}
+
+// Usage: main [--headless] [--bench] [--frames N] [--sizes WxH,WxH,...]
+//             [--bench-out path] [--profile-out path]
+//             [--record path | --playback path] [--file-bench path]
+//             [--write-bench path] [--huge-pages] [--assets path]
+//             [--backbuffer WxH] [--integer-scale] [--deterministic]
+//             [--check-replay path]
+fn parse_options(int argc, char* argv[], Options* options) -> bool {
+    for (i32 i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        const char* value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+
+        if (SDL_strcmp(arg, "--headless") == 0) {
+            options->headless = true;
+        } else if (SDL_strcmp(arg, "--bench") == 0) {
+            options->headless = true;
+            options->bench = true;
+        } else if (SDL_strcmp(arg, "--huge-pages") == 0) {
+            options->huge_pages = true;
+        } else if (SDL_strcmp(arg, "--frames") == 0 && value) {
+            options->bench_frames = SDL_max(SDL_atoi(value), 1);
+            ++i;
+        } else if (SDL_strcmp(arg, "--bench-out") == 0 && value) {
+            options->bench_output = value;
+            ++i;
+        } else if (SDL_strcmp(arg, "--profile-out") == 0 && value) {
+            options->profile_output = value;
+            ++i;
+        } else if (SDL_strcmp(arg, "--record") == 0 && value) {
+            options->record_path = value;
+            ++i;
+        } else if (SDL_strcmp(arg, "--playback") == 0 && value) {
+            options->playback_path = value;
+            ++i;
+        } else if (SDL_strcmp(arg, "--file-bench") == 0 && value) {
+            options->file_bench_path = value;
+            ++i;
+        } else if (SDL_strcmp(arg, "--write-bench") == 0 && value) {
+            options->headless = true;
+            options->write_bench_path = value;
+            ++i;
+        } else if (SDL_strcmp(arg, "--assets") == 0 && value) {
+            options->assets_path = value;
+            ++i;
+        } else if (SDL_strcmp(arg, "--backbuffer") == 0 && value) {
+            const char* cursor = value;
+            if (!parse_size(&cursor, &options->backbuffer_size) || *cursor) {
+                SDL_Log("Bad backbuffer size %s", value);
+                return false;
+            }
+            ++i;
+        } else if (SDL_strcmp(arg, "--integer-scale") == 0) {
+            options->integer_scale = true;
+        } else if (SDL_strcmp(arg, "--deterministic") == 0) {
+            options->deterministic = true;
+        } else if (SDL_strcmp(arg, "--check-replay") == 0 && value) {
+            options->headless = true;
+            options->deterministic = true;
+            options->check_replay = true;
+            options->playback_path = value;
+            ++i;
+        } else if (SDL_strcmp(arg, "--sizes") == 0 && value) {
+            const char* cursor = value;
+            while (*cursor &&
+                   options->bench_size_count <
+                       (i32)SDL_arraysize(options->bench_sizes)) {
+                if (!parse_size(
+                        &cursor,
+                        &options->bench_sizes[options->bench_size_count]
+                    ))
+                    break;
+
+                options->bench_size_count += 1;
+                if (*cursor == ',') {
+                    ++cursor;
+                }
+            }
+            ++i;
+        } else {
+            SDL_Log("Unknown argument %s", arg);
+            return false;
+        }
+    }
+
+    if (options->bench_size_count == 0) {
+        options->bench_sizes[options->bench_size_count++] = {1280, 720};
+        options->bench_sizes[options->bench_size_count++] = {1920, 1080};
+        options->bench_sizes[options->bench_size_count++] = {3840, 2160};
+    }
+
+    return true;
+}
+
+struct SynthBenchResult {
+    u32 voice_count;
+    f64 voices_per_core;
+    f64 sdl_sinf_voices_per_core;
+    f32 sine_max_error;
+};
+
+// Renders one second of every TONES preset in every waveform through the
+// oscillator bank, and the same number of voices through the old per-sample
+// SDL_sinf loop, and reports how many voices one core could keep up with.
+fn benchmark_synth() -> SynthBenchResult {
+    constexpr u32 BLOCK_SAMPLES = 480;
+    constexpr u32 BLOCK_COUNT = (u32)SAMPLE_RATE / BLOCK_SAMPLES;
+
+    static SynthVoices synth;
+    static f32 block[BLOCK_SAMPLES];
+    volatile f32 sink = 0.0f;
+
+    init_synth(&synth, SAMPLE_RATE);
+    for (u8 waveform = 0; waveform < WaveformCount; ++waveform) {
+        for (u8 tone = 0; tone < TONES_LEN; ++tone) {
+            add_synth_voice(&synth, (Waveform)waveform, TONES[tone], 0.01f);
+        }
+    }
+
+    u64 synth_start_ns = SDL_GetTicksNS();
+    for (u32 i = 0; i < BLOCK_COUNT; ++i) {
+        render_synth(&synth, block, BLOCK_SAMPLES);
+        sink = sink + block[i % BLOCK_SAMPLES];
+    }
+    u64 synth_ns = SDL_GetTicksNS() - synth_start_ns;
+
+    f32 wave_periods[MAX_SYNTH_VOICES] = {};
+    u64 sinf_start_ns = SDL_GetTicksNS();
+    for (u32 i = 0; i < BLOCK_COUNT; ++i) {
+        memset(block, 0, sizeof(block));
+
+        for (u32 voice = 0; voice < synth.count; ++voice) {
+            f32 step = TONES[voice % TONES_LEN] / SAMPLE_RATE;
+
+            for (u32 sample = 0; sample < BLOCK_SAMPLES; ++sample) {
+                f32 phase = wave_periods[voice] * 2.0f * SDL_PI_F;
+                block[sample] += SDL_sinf(phase) * 0.01f;
+
+                wave_periods[voice] += step;
+                if (wave_periods[voice] >= 1.0f) {
+                    wave_periods[voice] -= 1.0f;
+                }
+            }
+        }
+
+        sink = sink + block[i % BLOCK_SAMPLES];
+    }
+    u64 sinf_ns = SDL_GetTicksNS() - sinf_start_ns;
+
+    f64 rendered_ns = BLOCK_COUNT * BLOCK_SAMPLES * SDL_NS_PER_SECOND /
+                      (f64)SAMPLE_RATE;
+
+    return SynthBenchResult{
+        .voice_count = synth.count,
+        .voices_per_core = synth.count * rendered_ns / SDL_max(synth_ns, 1),
+        .sdl_sinf_voices_per_core =
+            synth.count * rendered_ns / SDL_max(sinf_ns, 1),
+        .sine_max_error = measure_synth_sine_error(),
+    };
+}
+
+struct EntityBenchResult {
+    u32 entity_count;
+    f64 soa_per_ms;
+    f64 aos_per_ms;
+    f32 max_difference;
+};
+
+// The same entities as an array of structs, for comparison.
+struct EntityAoS {
+    f32 position_x;
+    f32 position_y;
+    f32 velocity_x;
+    f32 velocity_y;
+    u32 flags;
+    u32 generation;
+    u32 next_free;
+};
+
+// Integrates a world's worth of entities many times over, once through the
+// SoA store's SIMD pass and once through a plain loop over an array of
+// structs, and reports how many entity updates per millisecond each managed.
+// Both start from the same entities, and the worst disagreement between
+// their final positions is reported alongside.
+fn benchmark_entities() -> EntityBenchResult {
+    constexpr u32 ENTITY_COUNT = 100000;
+    constexpr i32 STEPS = 200;
+    constexpr f32 DT = 1.0f / 60.0f;
+    constexpr f32 MAX_X = 4096.0f;
+    constexpr f32 MAX_Y = 4096.0f;
+
+    let arena = FixedBufferAllocator::reserve(MB(64));
+    defer { arena.destroy(); };
+
+    EntityStore store = create_entity_store(&arena, ENTITY_COUNT);
+    EntityAoS* entities = arena.alloc<EntityAoS>(ENTITY_COUNT);
+
+    Uint64 seed = 0x5EED;
+    for (u32 i = 0; i < ENTITY_COUNT; ++i) {
+        EntityHandle handle = create_entity(&store);
+        store.position_x[i] = SDL_randf_r(&seed) * MAX_X;
+        store.position_y[i] = SDL_randf_r(&seed) * MAX_Y;
+        store.velocity_x[i] = (SDL_randf_r(&seed) * 2.0f - 1.0f) * 200.0f;
+        store.velocity_y[i] = (SDL_randf_r(&seed) * 2.0f - 1.0f) * 200.0f;
+
+        entities[i] = EntityAoS{
+            .position_x = store.position_x[i],
+            .position_y = store.position_y[i],
+            .velocity_x = store.velocity_x[i],
+            .velocity_y = store.velocity_y[i],
+            .flags = EntityAlive,
+            .generation = handle.generation,
+            .next_free = ENTITY_NO_FREE_SLOT,
+        };
+    }
+
+    u64 soa_start_ns = SDL_GetTicksNS();
+    for (i32 step = 0; step < STEPS; ++step) {
+        integrate_entities(&store, DT, MAX_X, MAX_Y);
+    }
+    u64 soa_ns = SDL_GetTicksNS() - soa_start_ns;
+
+    u64 aos_start_ns = SDL_GetTicksNS();
+    for (i32 step = 0; step < STEPS; ++step) {
+        for (u32 i = 0; i < ENTITY_COUNT; ++i) {
+            EntityAoS* entity = &entities[i];
+            if (!(entity->flags & EntityAlive))
+                continue;
+
+            f32 x = entity->position_x + entity->velocity_x * DT;
+            f32 y = entity->position_y + entity->velocity_y * DT;
+
+            if (x < 0.0f)
+                entity->velocity_x = SDL_fabsf(entity->velocity_x);
+            if (x > MAX_X)
+                entity->velocity_x = -SDL_fabsf(entity->velocity_x);
+            if (y < 0.0f)
+                entity->velocity_y = SDL_fabsf(entity->velocity_y);
+            if (y > MAX_Y)
+                entity->velocity_y = -SDL_fabsf(entity->velocity_y);
+
+            entity->position_x = SDL_clamp(x, 0.0f, MAX_X);
+            entity->position_y = SDL_clamp(y, 0.0f, MAX_Y);
+        }
+    }
+    u64 aos_ns = SDL_GetTicksNS() - aos_start_ns;
+
+    f32 max_difference = 0.0f;
+    for (u32 i = 0; i < ENTITY_COUNT; ++i) {
+        max_difference = SDL_max(
+            max_difference,
+            SDL_fabsf(store.position_x[i] - entities[i].position_x)
+        );
+        max_difference = SDL_max(
+            max_difference,
+            SDL_fabsf(store.position_y[i] - entities[i].position_y)
+        );
+    }
+
+    f64 updates = (f64)ENTITY_COUNT * STEPS;
+    return EntityBenchResult{
+        .entity_count = ENTITY_COUNT,
+        .soa_per_ms = updates / (SDL_max(soa_ns, 1) / 1000000.0),
+        .aos_per_ms = updates / (SDL_max(aos_ns, 1) / 1000000.0),
+        .max_difference = max_difference,
+    };
+}
+
+static fn compare_u64(const void* a, const void* b) -> int {
+    u64 lhs = *(const u64*)a;
+    u64 rhs = *(const u64*)b;
+    return (lhs > rhs) - (lhs < rhs);
+}
+
+struct FrameTimeStats {
+    f64 min_ms;
+    f64 median_ms;
+    f64 p99_ms;
+    f64 max_ms;
+};
+
+// Sorts frame_ns in place.
+fn frame_time_stats(u64* frame_ns, i32 count) -> FrameTimeStats {
+    SDL_qsort(frame_ns, count, sizeof(u64), compare_u64);
+
+    i32 last = count - 1;
+    i32 p99_index = SDL_min((i32)(count * 0.99f), last);
+
+    return FrameTimeStats{
+        .min_ms = frame_ns[0] / 1000000.0,
+        .median_ms = frame_ns[last / 2] / 1000000.0,
+        .p99_ms = frame_ns[p99_index] / 1000000.0,
+        .max_ms = frame_ns[last] / 1000000.0,
+    };
+}
+
+// One frame of the headless frame path. There is no audio device, so the
+// sound cost is measured by mixing one frame's worth of samples.
+fn run_bench_frame(GameInput** prev_input, GameInput** curr_input) -> void {
+    constexpr u32 SAMPLES_PER_FRAME = (u32)(SAMPLE_RATE / 60.0f);
+    f32 samples[SAMPLES_PER_FRAME];
+
+    handle_input(*prev_input, *curr_input);
+    (*curr_input)->dt_for_frame = 1.0f / DEFAULT_REFRESH_HZ;
+    apply_input_recording(*curr_input);
+    game.code.update(&game.memory, *curr_input);
+    end_recorded_frame(*curr_input);
+    render();
+    game.sound.mixer.fill(&game.sound.mixer, samples, SAMPLES_PER_FRAME);
+
+    GameInput* temp = *prev_input;
+    *prev_input = *curr_input;
+    *curr_input = temp;
+}
+
+// Plays the recording being played back through once, start to finish, with
+// no rendering, and compares the state after every update with the hash
+// recorded for that frame. Returns false at the first frame that differs.
+fn run_replay_check(GameInput* input) -> bool {
+    InputRecorder* recorder = &game.recorder;
+    u64 expected_hash = 0;
+    u64 start_ns = SDL_GetTicksNS();
+
+    while (read_recorded_frame(recorder, input, &expected_hash)) {
+        game.code.update(&game.memory, input);
+
+        u64 state_hash = hash_game_state(&game.memory);
+        if (state_hash != expected_hash) {
+            log_state_divergence(
+                recorder->frame_count,
+                expected_hash,
+                state_hash
+            );
+            return false;
+        }
+    }
+
+    if (recorder->frame_count == 0) {
+        SDL_Log("Nothing recorded to check");
+        return false;
+    }
+
+    SDL_Log(
+        "Replayed %" SDL_PRIu64 " frames in %.2f ms, all matching",
+        recorder->frame_count,
+        (SDL_GetTicksNS() - start_ns) / 1000000.0
+    );
+    return true;
+}
+
+// The process's resident set, or 0 where there's no way to ask for it.
+fn resident_memory_bytes() -> usize {
+#if defined(SDL_PLATFORM_LINUX)
+    SDL_IOStream* file = SDL_IOFromFile("/proc/self/statm", "r");
+    if (!file) {
+        return 0;
+    }
+    defer { SDL_CloseIO(file); };
+
+    char statm[128] = {};
+    SDL_ReadIO(file, statm, sizeof(statm) - 1);
+
+    // Total pages, then resident pages.
+    char* resident = nullptr;
+    SDL_strtoull(statm, &resident, 10);
+    return SDL_strtoull(resident, nullptr, 10) * sysconf(_SC_PAGESIZE);
+#elif defined(SDL_PLATFORM_WINDOWS)
+    PROCESS_MEMORY_COUNTERS counters = {};
+    if (!GetProcessMemoryInfo(
+            GetCurrentProcess(),
+            &counters,
+            sizeof(counters)
+        )) {
+        return 0;
+    }
+
+    return counters.WorkingSetSize;
+#else
+    return 0;
+#endif
+}
+
+// Every call into SDL's allocator, counted so the benchmark can check that
+// steady-state frames never touch the heap. Installed before SDL is
+// initialized, as SDL_SetMemoryFunctions requires.
+static SDL_AtomicInt heap_call_count;
+static SDL_malloc_func original_malloc;
+static SDL_calloc_func original_calloc;
+static SDL_realloc_func original_realloc;
+static SDL_free_func original_free;
+
+static void* SDLCALL counting_malloc(size_t size) {
+    SDL_AddAtomicInt(&heap_call_count, 1);
+    return original_malloc(size);
+}
+
+static void* SDLCALL counting_calloc(size_t count, size_t size) {
+    SDL_AddAtomicInt(&heap_call_count, 1);
+    return original_calloc(count, size);
+}
+
+static void* SDLCALL counting_realloc(void* memory, size_t size) {
+    SDL_AddAtomicInt(&heap_call_count, 1);
+    return original_realloc(memory, size);
+}
+
+static void SDLCALL counting_free(void* memory) {
+    SDL_AddAtomicInt(&heap_call_count, 1);
+    original_free(memory);
+}
+
+fn install_heap_call_counter() -> void {
+    SDL_GetOriginalMemoryFunctions(
+        &original_malloc,
+        &original_calloc,
+        &original_realloc,
+        &original_free
+    );
+    SDL_SetMemoryFunctions(
+        counting_malloc,
+        counting_calloc,
+        counting_realloc,
+        counting_free
+    );
+}
+
+// Blit throughput at one buffer size, in megapixels per second.
+struct BlitBenchResult {
+    i32 width;
+    i32 height;
+    f64 opaque_mps;
+    f64 blended_mps;
+    f64 subpixel_mps;
+    f64 scalar_blended_mps;
+};
+
+// A size x size sprite: a gradient, and if blended, cut to a disc whose edge
+// fades out over a quarter of its radius.
+fn create_bench_bitmap(FixedBufferAllocator* arena, i32 size, bool blended)
+    -> Bitmap {
+    Bitmap bitmap = {};
+    bitmap.width = size;
+    bitmap.height = size;
+    bitmap.pitch = size * (i32)sizeof(u32);
+    bitmap.pixels = (u32*)arena->alloc_bytes((usize)bitmap.pitch * size, 64);
+    bitmap.is_opaque = !blended;
+
+    f32 radius = size * 0.5f;
+    for (i32 y = 0; y < size; ++y) {
+        for (i32 x = 0; x < size; ++x) {
+            f32 dx = x + 0.5f - radius;
+            f32 dy = y + 0.5f - radius;
+            f32 edge = (radius - SDL_sqrtf(dx * dx + dy * dy)) / (radius / 4);
+            u32 alpha = blended
+                          ? (u32)(SDL_clamp(edge, 0.0f, 1.0f) * 255.0f + 0.5f)
+                          : 255;
+
+            u32 color = (u32)(x * 255 / size) << 16 |
+                        (u32)(y * 255 / size) << 8 | 0x80;
+            u32 premultiplied = 0;
+            for (u32 shift = 0; shift < 24; shift += 8) {
+                premultiplied |= div255(((color >> shift) & 0xFF) * alpha)
+                                 << shift;
+            }
+            bitmap.pixels[y * size + x] = (alpha << 24) | premultiplied;
+        }
+    }
+
+    return bitmap;
+}
+
+// Covers a width x height buffer with sprites, over and over, and reports
+// megapixels per second written for opaque copies, blends on the pixel grid,
+// filtered blends off it, and the scalar blend loop for comparison.
+fn benchmark_blits(i32 width, i32 height) -> BlitBenchResult {
+    constexpr i32 SPRITE_SIZE = 256;
+    constexpr i32 PASSES = 20;
+
+    BlitBenchResult result = {};
+    result.width = width;
+    result.height = height;
+
+    OffscreenBuffer buffer = create_offscreen_buffer(width, height);
+    if (!buffer.memory) {
+        return result;
+    }
+    defer { destroy_offscreen_buffer(&buffer); };
+    memset(buffer.memory, 0x40, (usize)buffer.pitch * height);
+
+    let arena = FixedBufferAllocator::reserve(MB(1));
+    defer { arena.destroy(); };
+    Bitmap opaque = create_bench_bitmap(&arena, SPRITE_SIZE, false);
+    Bitmap blended = create_bench_bitmap(&arena, SPRITE_SIZE, true);
+    if (!opaque.pixels || !blended.pixels) {
+        return result;
+    }
+
+    ClipRect clip = buffer_clip_rect(&buffer);
+    f64 megapixels = (f64)width * height * PASSES / 1000000.0;
+
+    let time_passes = [&](Bitmap* bitmap, f32 offset) {
+        u64 start_ns = SDL_GetTicksNS();
+        for (i32 pass = 0; pass < PASSES; ++pass) {
+            for (i32 y = 0; y < height; y += SPRITE_SIZE) {
+                for (i32 x = 0; x < width; x += SPRITE_SIZE) {
+                    draw_bitmap(
+                        &buffer,
+                        clip,
+                        bitmap,
+                        x + offset,
+                        y + offset,
+                        &arena
+                    );
+                }
+            }
+        }
+        u64 elapsed_ns = SDL_max(SDL_GetTicksNS() - start_ns, 1);
+        return megapixels / (elapsed_ns / 1000000000.0);
+    };
+
+    result.opaque_mps = time_passes(&opaque, 0.0f);
+    result.blended_mps = time_passes(&blended, 0.0f);
+    result.subpixel_mps = time_passes(&blended, 0.37f);
+
+    u64 scalar_start_ns = SDL_GetTicksNS();
+    for (i32 pass = 0; pass < PASSES; ++pass) {
+        for (i32 y = 0; y < height; ++y) {
+            u32* row = (u32*)(buffer.memory + y * buffer.pitch);
+            u32* src = blended.pixels + (y % SPRITE_SIZE) * SPRITE_SIZE;
+            for (i32 x = 0; x < width; x += SPRITE_SIZE) {
+                blend_row_scalar(row + x, src, SDL_min(SPRITE_SIZE, width - x));
+            }
+        }
+    }
+    u64 scalar_ns = SDL_max(SDL_GetTicksNS() - scalar_start_ns, 1);
+    result.scalar_blended_mps = megapixels / (scalar_ns / 1000000000.0);
+
+    return result;
+}
+
+// Runs the frame path without a window for each requested size and reports
+// frame time statistics as JSON, along with how many heap calls the measured
+// frames made and how much of each arena they needed. The oscillator bank and
+// the entity store are benchmarked separately at the end. With --playback the
+// frames are driven by a recording, replayed from the start for each size.
+fn run_benchmark(
+    Options* options,
+    GameInput* prev_input,
+    GameInput* curr_input
+) -> bool {
+    constexpr i32 WARMUP_FRAMES = 10;
+
+    if (!game.code.library) {
+        SDL_Log("Nothing to benchmark without the game library");
+        return false;
+    }
+
+    u64* frame_ns = (u64*)SDL_malloc(sizeof(u64) * options->bench_frames);
+    if (!frame_ns) {
+        SDL_Log("Buy more RAM lol!");
+        return false;
+    }
+    defer { SDL_free(frame_ns); };
+
+    static char json[8192];
+    usize json_used = 0;
+    let append = [&](const char* fmt, auto... args) {
+        i32 written = SDL_snprintf(
+            json + json_used,
+            sizeof(json) - json_used,
+            fmt,
+            args...
+        );
+        json_used = SDL_min(json_used + SDL_max(written, 0), sizeof(json) - 1);
+    };
+
+    append(
+        "{\"kernel\": \"%s\", \"threads\": %d, \"frames\": %d, "
+        "\"input\": \"%s\", \"results\": [",
+        game.gradient_kernel->name,
+        game.render_queue.thread_count + 1,
+        options->bench_frames,
+        options->playback_path ? options->playback_path : "live"
+    );
+
+    for (i32 size_index = 0; size_index < options->bench_size_count;
+         ++size_index) {
+        BenchSize size = options->bench_sizes[size_index];
+
+        if (!resize_backbuffers(size.width, size.height)) {
+            return false;
+        }
+
+        // Every size replays the same frames twice: once redrawing every
+        // tile every frame, and once redrawing only the tiles that changed.
+        i32 heap_calls = 0;
+        let run_frames = [&](bool redraw_everything) -> FrameTimeStats {
+            if (game.recorder.mode == InputRecordingPlayingBack) {
+                rewind_playback(&game.recorder, &game.memory);
+            }
+
+            for (i32 frame = -WARMUP_FRAMES; frame < options->bench_frames;
+                 ++frame) {
+                if (frame == 0 && redraw_everything) {
+                    heap_calls = -SDL_GetAtomicInt(&heap_call_count);
+                }
+
+                if (redraw_everything) {
+                    invalidate_backbuffers();
+                }
+
+                u64 frame_start_ns = SDL_GetTicksNS();
+                run_bench_frame(&prev_input, &curr_input);
+
+                if (frame >= 0) {
+                    frame_ns[frame] = SDL_GetTicksNS() - frame_start_ns;
+                    PROFILE_FRAME_END(frame_ns[frame]);
+                }
+            }
+            if (redraw_everything) {
+                heap_calls += SDL_GetAtomicInt(&heap_call_count);
+            }
+            finish_rendering();
+
+            return frame_time_stats(frame_ns, options->bench_frames);
+        };
+
+        FrameTimeStats stats = run_frames(true);
+        FrameTimeStats incremental = run_frames(false);
+        append(
+            "%s{\"width\": %d, \"height\": %d, \"min_ms\": %.4f, "
+            "\"median_ms\": %.4f, \"p99_ms\": %.4f, \"max_ms\": %.4f, "
+            "\"incremental_median_ms\": %.4f, "
+            "\"incremental_p99_ms\": %.4f, \"heap_calls\": %d}",
+            size_index ? ", " : "",
+            size.width,
+            size.height,
+            stats.min_ms,
+            stats.median_ms,
+            stats.p99_ms,
+            stats.max_ms,
+            incremental.median_ms,
+            incremental.p99_ms,
+            heap_calls
+        );
+    }
+
+    append("], \"blits\": [");
+    const BenchSize blit_sizes[] = {{1920, 1080}, {3840, 2160}};
+    for (i32 i = 0; i < (i32)SDL_arraysize(blit_sizes); ++i) {
+        BlitBenchResult blits =
+            benchmark_blits(blit_sizes[i].width, blit_sizes[i].height);
+        append(
+            "%s{\"width\": %d, \"height\": %d, \"opaque_mps\": %.0f, "
+            "\"blended_mps\": %.0f, \"subpixel_blended_mps\": %.0f, "
+            "\"scalar_blended_mps\": %.0f}",
+            i ? ", " : "",
+            blits.width,
+            blits.height,
+            blits.opaque_mps,
+            blits.blended_mps,
+            blits.subpixel_mps,
+            blits.scalar_blended_mps
+        );
+    }
+
+    SynthBenchResult synth = benchmark_synth();
+    EntityBenchResult entities = benchmark_entities();
+    append(
+        "], \"synth\": {\"voices\": %u, \"sample_rate\": %d, "
+        "\"voices_per_core\": %.1f, \"sdl_sinf_voices_per_core\": %.1f, "
+        "\"sine_max_error\": %.3g, \"sine_error_bound\": %.3g}, "
+        "\"entities\": {\"count\": %u, \"soa_simd_per_ms\": %.0f, "
+        "\"aos_scalar_per_ms\": %.0f, \"max_difference\": %.3g}, "
+        "\"memory\": {\"startup_ms\": %.2f, \"startup_rss_bytes\": %zu, "
+        "\"persistent_used\": %zu, "
+        "\"persistent_high_water\": %zu, \"transient_high_water\": %zu, "
+        "\"worker_scratch_high_water\": %zu}}\n",
+        synth.voice_count,
+        (i32)SAMPLE_RATE,
+        synth.voices_per_core,
+        synth.sdl_sinf_voices_per_core,
+        synth.sine_max_error,
+        MAX_SYNTH_SINE_ERROR,
+        entities.entity_count,
+        entities.soa_per_ms,
+        entities.aos_per_ms,
+        entities.max_difference,
+        game.startup_ns / 1000000.0,
+        game.startup_resident_bytes,
+        game.memory.persistent_storage.used,
+        game.memory.persistent_storage.high_water,
+        game.memory.transient_storage.high_water,
+        work_queue_scratch_high_water(&game.render_queue)
+    );
+
+    if (options->bench_output) {
+        return write_file(options->bench_output, json, json_used);
+    }
+
+    fwrite(json, 1, json_used, stdout);
+    return true;
+}
+
+// Sums the file as u64 words so every byte is actually read.
+fn checksum_bytes(const u8* data, usize size) -> u64 {
+    u64 sum = 0;
+    usize word_count = size / sizeof(u64);
+
+    for (usize i = 0; i < word_count; ++i) {
+        u64 word;
+        memcpy(&word, data + i * sizeof(u64), sizeof(word));
+        sum += word;
+    }
+    for (usize i = word_count * sizeof(u64); i < size; ++i) {
+        sum += data[i];
+    }
+
+    return sum;
+}
+
+fn create_file_bench_file(const char* filename, usize size) -> bool {
+    SDL_Log("Creating %zu MB test file %s", size / MB(1), filename);
+
+    SDL_IOStream* file = SDL_IOFromFile(filename, "wb");
+    if (!file) {
+        SDL_Log("Failed to create file %s: %s", filename, SDL_GetError());
+        return false;
+    }
+    defer { SDL_CloseIO(file); };
+
+    static u64 chunk[MB(1) / sizeof(u64)];
+    for (usize written = 0; written < size; written += sizeof(chunk)) {
+        for (usize i = 0; i < SDL_arraysize(chunk); ++i) {
+            chunk[i] = (written / sizeof(u64) + i) * 0x9E3779B97F4A7C15ull;
+        }
+
+        usize count = SDL_min(sizeof(chunk), size - written);
+        if (SDL_WriteIO(file, chunk, count) != count) {
+            SDL_Log("Failed to write complete data to file");
+            return false;
+        }
+    }
+
+    return true;
+}
+
+struct FileBenchResult {
+    f64 best_ms;
+    u64 checksum;
+};
+
+// Loads and checksums the file through read_entire_file, a plain mapping, and
+// a mapping advised for sequential read-ahead. Each way runs a few times and
+// keeps its best time: the page cache is warm after the first run, so the
+// numbers compare the copy against the mapping rather than the disk. Last, it
+// streams the file in through the async loader and reports the worst cost of
+// polling for it.
+fn run_file_benchmark(Options* options) -> bool {
+    constexpr i32 RUNS = 3;
+    constexpr usize DEFAULT_FILE_SIZE = GB(1);
+
+    const char* filename = options->file_bench_path;
+    if (!SDL_GetPathInfo(filename, nullptr) &&
+        !create_file_bench_file(filename, DEFAULT_FILE_SIZE)) {
+        return false;
+    }
+
+    SDL_PathInfo info;
+    if (!SDL_GetPathInfo(filename, &info) || info.size == 0) {
+        SDL_Log("Nothing to benchmark in %s", filename);
+        return false;
+    }
+
+    // Allocated and cleared up front, unlike the game's arenas, which commit
+    // as they grow: every page is already faulted in before the first read,
+    // so the timings are of the read path alone.
+    let arena = FixedBufferAllocator::create(info.size);
+    defer { arena.destroy(); };
+
+    let time_runs = [&](bool map, FileAdvice advice, FileBenchResult* result) {
+        result->best_ms = 1.0e30;
+
+        for (i32 run = 0; run < RUNS; ++run) {
+            u64 start_ns = SDL_GetTicksNS();
+            MappedFile mapped = {};
+
+            if (map) {
+                let view = map_entire_file(filename, nullptr);
+                if (!view)
+                    return false;
+                mapped = *view;
+                advise_mapped_file(&mapped, advice);
+            } else {
+                arena.used = 0;
+                let read = read_entire_file(filename, &arena);
+                if (!read)
+                    return false;
+                mapped.file = *read;
+            }
+
+            File* file = &mapped.file;
+            result->checksum = checksum_bytes(file->data, file->size);
+            unmap_file(&mapped);
+
+            f64 ms = (SDL_GetTicksNS() - start_ns) / 1000000.0;
+            result->best_ms = SDL_min(result->best_ms, ms);
+        }
+
+        return true;
+    };
+
+    FileBenchResult read = {}, mapped = {}, sequential = {};
+    if (!time_runs(false, FileAdviceNormal, &read) ||
+        !time_runs(true, FileAdviceNormal, &mapped) ||
+        !time_runs(true, FileAdviceSequential, &sequential)) {
+        return false;
+    }
+
+    // Streams the file in on the I/O threads while this thread keeps polling
+    // once a millisecond, the way the main loop polls once a frame.
+    static AsyncLoader loader;
+    if (!init_async_loader(&loader)) {
+        return false;
+    }
+    defer { shutdown_async_loader(&loader); };
+
+    arena.used = 0;
+    u64 async_start_ns = SDL_GetTicksNS();
+    if (!begin_async_load(&loader, filename, &arena, 0)) {
+        return false;
+    }
+
+    AsyncLoadCompletion completion = {};
+    u64 max_poll_ns = 0;
+    for (;;) {
+        u64 poll_start_ns = SDL_GetTicksNS();
+        u32 completed = poll_async_loads(&loader, &completion, 1);
+        max_poll_ns = SDL_max(max_poll_ns, SDL_GetTicksNS() - poll_start_ns);
+
+        if (completed)
+            break;
+        SDL_DelayNS(SDL_NS_PER_MS);
+    }
+
+    f64 async_ms = (SDL_GetTicksNS() - async_start_ns) / 1000000.0;
+    u64 async_checksum =
+        checksum_bytes(completion.file.data, completion.file.size);
+
+    if (mapped.checksum != read.checksum ||
+        sequential.checksum != read.checksum ||
+        !completion.succeeded || async_checksum != read.checksum) {
+        SDL_Log("Mapped, streamed and read contents differ");
+        return false;
+    }
+
+    f64 gb = info.size / (f64)GB(1);
+    static char json[1024];
+    i32 json_used = SDL_snprintf(
+        json,
+        sizeof(json),
+        "{\"file\": \"%s\", \"bytes\": %" SDL_PRIu64 ", \"runs\": %d, "
+        "\"read_ms\": %.2f, \"read_gb_per_s\": %.2f, "
+        "\"read_arena_bytes\": %" SDL_PRIu64 ", "
+        "\"map_ms\": %.2f, \"map_gb_per_s\": %.2f, "
+        "\"map_sequential_ms\": %.2f, \"map_sequential_gb_per_s\": %.2f, "
+        "\"map_arena_bytes\": 0, \"async_ms\": %.2f, "
+        "\"async_max_poll_us\": %.2f}\n",
+        filename,
+        info.size,
+        RUNS,
+        read.best_ms,
+        gb / (read.best_ms / 1000.0),
+        info.size,
+        mapped.best_ms,
+        gb / (mapped.best_ms / 1000.0),
+        sequential.best_ms,
+        gb / (sequential.best_ms / 1000.0),
+        async_ms,
+        max_poll_ns / 1000.0
+    );
+    json_used = SDL_clamp(json_used, 0, (i32)sizeof(json) - 1);
+
+    if (options->bench_output) {
+        return write_file(options->bench_output, json, json_used);
+    }
+
+    fwrite(json, 1, json_used, stdout);
+    return true;
+}
+
+// Runs the headless frame path three times over: with no writes, with a large
+// save always in flight on the async writer, and with the same saves written
+// on the frame thread at the frames the async run started them. Reports frame
+// time statistics for each as JSON, so the cost of a save shows up as the
+// difference in p99 and max frame time.
+fn run_write_benchmark(
+    Options* options,
+    GameInput* prev_input,
+    GameInput* curr_input
+) -> bool {
+    constexpr usize SAVE_SIZE = MB(256);
+    constexpr i32 MAX_SAVES = 64;
+
+    if (!game.code.library) {
+        SDL_Log("Nothing to benchmark without the game library");
+        return false;
+    }
+
+    i32 frames = options->bench_frames;
+    u64* frame_ns = (u64*)SDL_malloc(sizeof(u64) * frames);
+    u64* save = (u64*)SDL_malloc(SAVE_SIZE);
+    if (!frame_ns || !save) {
+        SDL_Log("Buy more RAM lol!");
+        SDL_free(frame_ns);
+        SDL_free(save);
+        return false;
+    }
+    defer {
+        SDL_free(frame_ns);
+        SDL_free(save);
+    };
+
+    for (usize i = 0; i < SAVE_SIZE / sizeof(u64); ++i) {
+        save[i] = i * 0x9E3779B97F4A7C15ull;
+    }
+
+    const char* filename = options->write_bench_path;
+    i32 save_frames[MAX_SAVES] = {};
+    i32 save_count = 0;
+    u64 save_ns = 0;
+
+    // Paced like the real loop, so a save spans as many frames as it would
+    // in game.
+    let end_frame = [&](i32 frame, u64 frame_start_ns) {
+        frame_ns[frame] = SDL_GetTicksNS() - frame_start_ns;
+        end_scheduled_frame(&game.scheduler, false);
+    };
+
+    FrameTimeStats idle = {}, async = {}, blocking = {};
+
+    for (i32 frame = 0; frame < frames; ++frame) {
+        u64 frame_start_ns = SDL_GetTicksNS();
+        run_bench_frame(&prev_input, &curr_input);
+        end_frame(frame, frame_start_ns);
+    }
+    idle = frame_time_stats(frame_ns, frames);
+
+    bool in_flight = false;
+    for (i32 frame = 0; frame < frames; ++frame) {
+        u64 frame_start_ns = SDL_GetTicksNS();
+
+        AsyncWriteCompletion completion;
+        if (poll_async_writes(&game.writer, &completion, 1)) {
+            if (!completion.succeeded) {
+                return false;
+            }
+            save_ns += completion.elapsed_ns;
+            in_flight = false;
+        }
+
+        if (!in_flight && save_count < MAX_SAVES &&
+            begin_async_write(&game.writer, filename, save, SAVE_SIZE, 0)) {
+            save_frames[save_count++] = frame;
+            in_flight = true;
+        }
+
+        run_bench_frame(&prev_input, &curr_input);
+        end_frame(frame, frame_start_ns);
+    }
+    async = frame_time_stats(frame_ns, frames);
+
+    // Lets the last save finish before the blocking run starts timing.
+    complete_all_work(&game.writer.queue);
+    AsyncWriteCompletion completion;
+    while (poll_async_writes(&game.writer, &completion, 1)) {
+        save_ns += completion.elapsed_ns;
+    }
+
+    i32 next_save = 0;
+    for (i32 frame = 0; frame < frames; ++frame) {
+        u64 frame_start_ns = SDL_GetTicksNS();
+
+        if (next_save < save_count && save_frames[next_save] == frame) {
+            if (!write_file_atomically(filename, save, SAVE_SIZE)) {
+                return false;
+            }
+            next_save += 1;
+        }
+
+        run_bench_frame(&prev_input, &curr_input);
+        end_frame(frame, frame_start_ns);
+    }
+    blocking = frame_time_stats(frame_ns, frames);
+
+    SDL_PathInfo info;
+    if (!SDL_GetPathInfo(filename, &info) || info.size != SAVE_SIZE) {
+        SDL_Log("%s doesn't hold the last save", filename);
+        return false;
+    }
+
+    static char json[1024];
+    i32 json_used = SDL_snprintf(
+        json,
+        sizeof(json),
+        "{\"file\": \"%s\", \"save_bytes\": %zu, \"frames\": %d, "
+        "\"saves\": %d, \"async_save_ms\": %.2f, "
+        "\"idle\": {\"median_ms\": %.4f, \"p99_ms\": %.4f, \"max_ms\": %.4f}, "
+        "\"async\": {\"median_ms\": %.4f, \"p99_ms\": %.4f, "
+        "\"max_ms\": %.4f}, "
+        "\"blocking\": {\"median_ms\": %.4f, \"p99_ms\": %.4f, "
+        "\"max_ms\": %.4f}}\n",
+        filename,
+        SAVE_SIZE,
+        frames,
+        save_count,
+        save_count ? save_ns / 1000000.0 / save_count : 0.0,
+        idle.median_ms,
+        idle.p99_ms,
+        idle.max_ms,
+        async.median_ms,
+        async.p99_ms,
+        async.max_ms,
+        blocking.median_ms,
+        blocking.p99_ms,
+        blocking.max_ms
+    );
+    json_used = SDL_clamp(json_used, 0, (i32)sizeof(json) - 1);
+
+    if (options->bench_output) {
+        return write_file(options->bench_output, json, json_used);
+    }
+
+    fwrite(json, 1, json_used, stdout);
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    u64 start_ns = SDL_GetTicksNS();
+    Options options = {};
+    if (!parse_options(argc, argv, &options))
+        return -1;
+
+    if (options.bench) {
+        install_heap_call_counter();
+    }
+
+    if (options.file_bench_path) {
+        return run_file_benchmark(&options) ? 0 : -1;
+    }
+
+    game.headless = options.headless;
+    game.huge_pages = options.huge_pages;
+    game.assets_path = options.assets_path;
+    game.backbuffer_width = options.backbuffer_size.width;
+    game.backbuffer_height = options.backbuffer_size.height;
+    game.integer_scale = options.integer_scale;
+    game.deterministic = options.deterministic;
+
     if (!initialize())
         return -1;
     defer { shutdown(); };
 
-    let persistent_storage = FixedBufferAllocator::create(MB(64));
-    defer { persistent_storage.destroy(); };
+    game.startup_ns = SDL_GetTicksNS() - start_ns;
+    game.startup_resident_bytes = resident_memory_bytes();
 
-    let transient_storage = FixedBufferAllocator::create(MB(64));
-    defer { transient_storage.destroy(); };
+    defer {
+        PROFILE_LOG_CALL_SITES();
+        if (options.profile_output) {
+            PROFILE_WRITE_TRACE(options.profile_output);
+        }
+    };
 
-    let state = persistent_storage.alloc_initialized<GameState>();
+    GameInput* prev_input = &game.inputs[0];
+    GameInput* curr_input = &game.inputs[1];
 
-    let prev_input = transient_storage.alloc_initialized<GameInput>();
-    let curr_input = transient_storage.alloc_initialized<GameInput>();
+    if (options.playback_path) {
+        if (!begin_playback(
+                &game.recorder,
+                &game.memory,
+                options.playback_path
+            )) {
+            return -1;
+        }
+    } else if (options.record_path) {
+        if (!begin_recording(
+                &game.recorder,
+                &game.memory,
+                options.record_path
+            )) {
+            return -1;
+        }
+    }
+
+    if (options.check_replay) {
+        return run_replay_check(curr_input) ? 0 : -1;
+    }
+
+    if (options.bench) {
+        return run_benchmark(&options, prev_input, curr_input) ? 0 : -1;
+    }
+
+    if (options.write_bench_path) {
+        return run_write_benchmark(&options, prev_input, curr_input) ? 0 : -1;
+    }
 
     while (game.running) {
         u64 frame_start_ns = SDL_GetTicksNS();
 
-        handle_window_events(state);
-        handle_input(prev_input, curr_input, state);
-        update(curr_input, state);
-        handle_audio_stream(state);
-        render(state);
+        if (game_code_changed(&game.code)) {
+            reload_game_code();
+        }
+
+        handle_window_events();
+        handle_input(prev_input, curr_input);
+        curr_input->dt_for_frame = game.scheduler.seconds_per_frame;
+        apply_input_recording(curr_input);
+        if (!game.code.update(&game.memory, curr_input)) {
+            game.running = false;
+        }
+        end_recorded_frame(curr_input);
+        report_audio_underruns();
+        render();
 
         GameInput* temp = prev_input;
         prev_input = curr_input;
         curr_input = temp;
 
         u64 frame_end_ns = SDL_GetTicksNS();
-        [[maybe_unused]] u64 frame_ns = frame_end_ns - frame_start_ns;
+        u64 frame_ns = frame_end_ns - frame_start_ns;
+        PROFILE_FRAME_END(frame_ns);
+
+        // A presented frame already blocked on VSync; anything else (VSync
+        // unavailable, unfocused, headless, nothing changed) sleeps here
+        // instead of spinning. Deterministic frames always keep the
+        // scheduler's fixed rate, even on a display refreshing faster.
+        end_scheduled_frame(
+            &game.scheduler,
+            game.presented && game.vsync && !game.deterministic
+        );
     }
 
     return 0;
@@ -0,0 +1,199 @@
+#pragma once
+
+#include "core.h"
+
+// Read-only file views backed by the OS page cache. Mapping costs no arena
+// space and no up-front copy: pages are faulted in as they are first touched,
+// and advise_mapped_file() can ask for them to be read ahead. Where mapping
+// isn't available, or fails, the file is read into the fallback allocator
+// exactly like read_entire_file().
+
+#if defined(SDL_PLATFORM_WINDOWS)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#define HANDMADE_MMAP_WIN32 1
+#elif defined(SDL_PLATFORM_UNIX) || defined(SDL_PLATFORM_APPLE)
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define HANDMADE_MMAP_POSIX 1
+#endif
+
+struct MappedFile {
+    File file;
+    bool is_mapped;
+};
+
+enum FileAdvice {
+    FileAdviceNormal,
+    FileAdviceSequential,
+    FileAdviceRandom,
+    FileAdviceWillNeed,
+    FileAdviceDontNeed,
+};
+
+// fallback may be null, in which case a file that can't be mapped is an error.
+[[maybe_unused]]
+fn map_entire_file(const char* filename, FixedBufferAllocator* fallback)
+    -> std::expected<MappedFile, FileError> {
+#if HANDMADE_MMAP_POSIX
+    int fd = open(filename, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        SDL_Log("Failed to open file %s: %s", filename, strerror(errno));
+        return std::unexpected(InvalidFile);
+    }
+    // The mapping keeps its own reference to the file.
+    defer { close(fd); };
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0) {
+        SDL_Log("Failed to stat file %s: %s", filename, strerror(errno));
+        return std::unexpected(StatReadFailed);
+    }
+
+    if (file_stat.st_size == 0) {
+        return MappedFile{};
+    }
+
+    void* data =
+        mmap(nullptr, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data != MAP_FAILED) {
+        return MappedFile{
+            .file = {.data = (u8*)data, .size = (usize)file_stat.st_size},
+            .is_mapped = true,
+        };
+    }
+
+    SDL_Log("Failed to map file %s: %s", filename, strerror(errno));
+#elif HANDMADE_MMAP_WIN32
+    HANDLE file = CreateFileA(
+        filename,
+        GENERIC_READ,
+        FILE_SHARE_READ,
+        nullptr,
+        OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL,
+        nullptr
+    );
+    if (file == INVALID_HANDLE_VALUE) {
+        SDL_Log("Failed to open file %s: %lu", filename, GetLastError());
+        return std::unexpected(InvalidFile);
+    }
+    // The view keeps its own reference to the file and the mapping.
+    defer { CloseHandle(file); };
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size)) {
+        SDL_Log("Failed to get file size: %lu", GetLastError());
+        return std::unexpected(SizeReadFailed);
+    }
+
+    if (file_size.QuadPart == 0) {
+        return MappedFile{};
+    }
+
+    HANDLE mapping =
+        CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping) {
+        void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(mapping);
+
+        if (data) {
+            return MappedFile{
+                .file = {.data = (u8*)data, .size = (usize)file_size.QuadPart},
+                .is_mapped = true,
+            };
+        }
+    }
+
+    SDL_Log("Failed to map file %s: %lu", filename, GetLastError());
+#endif
+
+    if (!fallback) {
+        return std::unexpected(MapFailed);
+    }
+
+    let file = read_entire_file(filename, fallback);
+    if (!file) {
+        return std::unexpected(file.error());
+    }
+
+    return MappedFile{
+        .file = *file,
+        .is_mapped = false,
+    };
+}
+
+// Hints how a range of the view will be read; size 0 means to the end. Only
+// a hint: platforms without an equivalent ignore it, as do files that were
+// read instead of mapped.
+[[maybe_unused]]
+fn advise_mapped_file(
+    MappedFile* mapped,
+    FileAdvice advice,
+    usize offset = 0,
+    usize size = 0
+) -> void {
+    if (!mapped->is_mapped || offset >= mapped->file.size)
+        return;
+
+    if (size == 0 || size > mapped->file.size - offset) {
+        size = mapped->file.size - offset;
+    }
+
+#if HANDMADE_MMAP_POSIX
+    // madvise wants a page-aligned start.
+    usize page_size = (usize)sysconf(_SC_PAGESIZE);
+    usize aligned_offset = offset & ~(page_size - 1);
+    size += offset - aligned_offset;
+
+    // Indexed by FileAdvice.
+    constexpr int POSIX_ADVICE[] = {
+        MADV_NORMAL,
+        MADV_SEQUENTIAL,
+        MADV_RANDOM,
+        MADV_WILLNEED,
+        MADV_DONTNEED,
+    };
+
+    if (madvise(
+            mapped->file.data + aligned_offset,
+            size,
+            POSIX_ADVICE[advice]
+        ) != 0) {
+        SDL_LogDebug(
+            SDL_LOG_CATEGORY_SYSTEM,
+            "madvise failed: %s",
+            strerror(errno)
+        );
+    }
+#elif HANDMADE_MMAP_WIN32
+    // Windows only has an equivalent for read-ahead.
+    if (advice == FileAdviceWillNeed) {
+        WIN32_MEMORY_RANGE_ENTRY range = {
+            .VirtualAddress = mapped->file.data + offset,
+            .NumberOfBytes = size,
+        };
+        PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+    }
+#else
+    (void)advice;
+#endif
+}
+
+// Views read into the fallback allocator stay owned by that allocator.
+[[maybe_unused]]
+fn unmap_file(MappedFile* mapped) -> void {
+    if (mapped->is_mapped) {
+#if HANDMADE_MMAP_POSIX
+        munmap(mapped->file.data, mapped->file.size);
+#elif HANDMADE_MMAP_WIN32
+        UnmapViewOfFile(mapped->file.data);
+#endif
+    }
+
+    *mapped = {};
+}
@@ -0,0 +1,182 @@
+#pragma once
+
+#include "core.h"
+#include "synth.h"
+
+// Real-time mixer that runs inside the SDL audio stream callback. The game
+// thread never touches mixer state directly; it sends parameter changes
+// through a single-producer/single-consumer ring that the callback drains at
+// the start of every block, so neither side ever blocks on the other.
+
+constexpr u32 MIXER_COMMAND_CAPACITY = 256; // must be a power of two
+constexpr u32 MIXER_BLOCK_SAMPLES = 256;
+constexpr u32 MIXER_TONE_VOICE = 0;
+
+enum MixerCommandType : u32 {
+    MixerSetToneHz,
+    MixerSetVolume,
+};
+
+struct MixerCommand {
+    MixerCommandType type;
+    f32 value;
+};
+
+struct MixerCommandRing {
+    SDL_AtomicU32 write_index;
+    SDL_AtomicU32 read_index;
+    MixerCommand commands[MIXER_COMMAND_CAPACITY];
+};
+
+// Game thread only. Returns false if the audio thread has fallen a whole ring
+// behind, in which case the command is dropped.
+fn push_mixer_command(MixerCommandRing* ring, MixerCommand command) -> bool {
+    u32 write_index = SDL_GetAtomicU32(&ring->write_index);
+    u32 read_index = SDL_GetAtomicU32(&ring->read_index);
+
+    if (write_index - read_index >= MIXER_COMMAND_CAPACITY) {
+        return false;
+    }
+
+    ring->commands[write_index & (MIXER_COMMAND_CAPACITY - 1)] = command;
+
+    SDL_MemoryBarrierRelease();
+    SDL_SetAtomicU32(&ring->write_index, write_index + 1);
+
+    return true;
+}
+
+// Audio thread only.
+fn pop_mixer_command(MixerCommandRing* ring, MixerCommand* command) -> bool {
+    u32 read_index = SDL_GetAtomicU32(&ring->read_index);
+    u32 write_index = SDL_GetAtomicU32(&ring->write_index);
+
+    if (read_index == write_index) {
+        return false;
+    }
+
+    SDL_MemoryBarrierAcquire();
+    *command = ring->commands[read_index & (MIXER_COMMAND_CAPACITY - 1)];
+
+    SDL_SetAtomicU32(&ring->read_index, read_index + 1);
+
+    return true;
+}
+
+struct Mixer;
+
+// Fills samples for the callback. The platform points this at the game
+// library's game_get_sound_samples, swapping it with the stream locked.
+typedef void MixerFill(Mixer* mixer, f32* samples, u32 sample_count);
+
+struct Mixer {
+    MixerCommandRing commands;
+    MixerFill* fill;
+
+    // Game thread only: the last values that made it through commands, so
+    // only changes are sent. They live here rather than in the game's state
+    // because whether a push succeeds depends on the audio thread's timing.
+    f32 sent_tone_hz;
+    f32 sent_volume;
+
+    // Owned by the audio thread.
+    f32 sample_rate;
+    f32 tone_hz;
+    f32 volume;
+    SynthVoices synth;
+
+    u64 last_callback_ns;
+    u64 last_delivered_ns;
+
+    // Written by the audio thread, read by anyone.
+    SDL_AtomicInt callback_count;
+    SDL_AtomicInt underrun_count;
+};
+
+fn init_mixer(
+    Mixer* mixer,
+    MixerFill* fill,
+    f32 sample_rate,
+    f32 tone_hz,
+    f32 volume
+) -> void {
+    *mixer = {};
+    mixer->fill = fill;
+    mixer->sample_rate = sample_rate;
+    mixer->tone_hz = tone_hz;
+    mixer->volume = volume;
+    mixer->sent_tone_hz = tone_hz;
+    mixer->sent_volume = volume;
+
+    init_synth(&mixer->synth, sample_rate);
+    add_synth_voice(&mixer->synth, WaveformSine, tone_hz, volume);
+}
+
+fn apply_mixer_commands(Mixer* mixer) -> void {
+    MixerCommand command;
+
+    while (pop_mixer_command(&mixer->commands, &command)) {
+        switch (command.type) {
+            case MixerSetToneHz: {
+                mixer->tone_hz = command.value;
+                break;
+            }
+
+            case MixerSetVolume: {
+                mixer->volume = command.value;
+                break;
+            }
+        }
+    }
+
+    set_synth_voice(
+        &mixer->synth,
+        MIXER_TONE_VOICE,
+        WaveformSine,
+        mixer->tone_hz,
+        mixer->volume
+    );
+}
+
+fn mix_samples(Mixer* mixer, f32* samples, u32 sample_count) -> void {
+    apply_mixer_commands(mixer);
+    render_synth(&mixer->synth, samples, sample_count);
+}
+
+// SDL calls this on its audio thread whenever the device needs more data.
+// additional_amount is exactly what it needs beyond what is queued, so
+// supplying only that keeps the queue, and the latency, at one device buffer.
+static fn mixer_audio_callback(
+    void* userdata,
+    SDL_AudioStream* stream,
+    int additional_amount,
+    [[maybe_unused]] int total_amount
+) -> void {
+    Mixer* mixer = (Mixer*)userdata;
+    u64 now_ns = SDL_GetTicksNS();
+
+    // If the previous delivery ran dry well before the device asked again,
+    // the device played silence in between.
+    if (mixer->last_callback_ns && mixer->last_delivered_ns) {
+        u64 interval_ns = now_ns - mixer->last_callback_ns;
+        if (interval_ns > mixer->last_delivered_ns * 3 / 2) {
+            SDL_AddAtomicInt(&mixer->underrun_count, 1);
+        }
+    }
+
+    f32 samples[MIXER_BLOCK_SAMPLES];
+    u32 sample_count = additional_amount / sizeof(f32);
+    u32 delivered = 0;
+
+    while (delivered < sample_count) {
+        u32 count = SDL_min(sample_count - delivered, MIXER_BLOCK_SAMPLES);
+        mixer->fill(mixer, samples, count);
+        SDL_PutAudioStreamData(stream, samples, count * sizeof(f32));
+        delivered += count;
+    }
+
+    mixer->last_callback_ns = now_ns;
+    mixer->last_delivered_ns =
+        (u64)(delivered * (f64)SDL_NS_PER_SECOND / mixer->sample_rate);
+    SDL_AddAtomicInt(&mixer->callback_count, 1);
+}
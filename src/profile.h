@@ -0,0 +1,351 @@
+#pragma once
+
+#include "core.h"
+
+// Hot-path instrumentation. Build with -DHANDMADE_PROFILE=1 to turn it on;
+// otherwise every macro below compiles away to nothing.
+//
+//   TIMED_BLOCK("update");      // times the rest of the enclosing scope
+//   PROFILE_FRAME_END(frame_ns); // once per frame, after the frame's work
+//
+// Each TIMED_BLOCK site accumulates a hit count and a cycle count. Begin/end
+// events also go into a ring of per-frame buffers which
+// write_profile_trace() exports as Chrome trace JSON (chrome://tracing,
+// ui.perfetto.dev).
+//
+// The game library gets its own copy of everything here, so it points
+// global_profiler at the platform's with PROFILE_USE and numbers its call
+// sites from GAME_PROFILE_CALL_SITE_BASE to stay clear of the platform's.
+// Their names live in the game library, so the platform retires them with
+// PROFILE_RETIRE_CALL_SITES before unloading it.
+
+#ifndef HANDMADE_PROFILE
+#define HANDMADE_PROFILE 0
+#endif
+
+#define GAME_PROFILE_CALL_SITE_BASE 128
+
+#ifndef PROFILE_CALL_SITE_BASE
+#define PROFILE_CALL_SITE_BASE 0
+#endif
+
+#if HANDMADE_PROFILE
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+constexpr i32 MAX_PROFILE_CALL_SITES = 256;
+constexpr i32 PROFILE_FRAME_COUNT = 32;
+constexpr u32 MAX_PROFILE_EVENTS_PER_FRAME = 16384;
+
+enum ProfileEventType : u16 {
+    ProfileEventBegin,
+    ProfileEventEnd,
+};
+
+struct ProfileCallSite {
+    const char* name;
+    const char* file;
+    i32 line;
+    u64 hit_count;
+    u64 cycles;
+};
+
+struct ProfileEvent {
+    u64 clock;
+    u32 thread_id;
+    u16 call_site;
+    u16 type;
+};
+
+struct ProfileFrame {
+    u64 begin_clock;
+    u64 end_clock;
+    u64 frame_ns;
+    SDL_AtomicInt event_count;
+    SDL_AtomicInt dropped_count;
+    ProfileEvent events[MAX_PROFILE_EVENTS_PER_FRAME];
+};
+
+struct Profiler {
+    ProfileCallSite call_sites[MAX_PROFILE_CALL_SITES];
+    SDL_AtomicInt frame_index;
+    u32 frames_recorded;
+    ProfileFrame frames[PROFILE_FRAME_COUNT];
+};
+
+inline Profiler profiler_storage;
+inline Profiler* global_profiler = &profiler_storage;
+
+inline fn read_cycle_counter() -> u64 {
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return SDL_GetPerformanceCounter();
+#endif
+}
+
+inline fn record_profile_event(u16 call_site, ProfileEventType type) -> void {
+    u32 frame_index = SDL_GetAtomicInt(&global_profiler->frame_index);
+    ProfileFrame* frame = &global_profiler->frames[frame_index];
+
+    u32 index = SDL_AddAtomicInt(&frame->event_count, 1);
+    if (index >= MAX_PROFILE_EVENTS_PER_FRAME) {
+        SDL_AddAtomicInt(&frame->dropped_count, 1);
+        return;
+    }
+
+    ProfileEvent* event = &frame->events[index];
+    event->clock = SDL_GetPerformanceCounter();
+    event->thread_id = (u32)SDL_GetCurrentThreadID();
+    event->call_site = call_site;
+    event->type = type;
+}
+
+struct ProfileTimer {
+    u16 call_site;
+    u64 start_cycles;
+};
+
+inline fn begin_profile_block(
+    u16 call_site,
+    const char* name,
+    const char* file,
+    i32 line
+) -> ProfileTimer {
+    ProfileCallSite* site = &global_profiler->call_sites[call_site];
+    site->name = name;
+    site->file = file;
+    site->line = line;
+
+    record_profile_event(call_site, ProfileEventBegin);
+
+    return ProfileTimer{
+        .call_site = call_site,
+        .start_cycles = read_cycle_counter(),
+    };
+}
+
+inline fn end_profile_block(ProfileTimer* timer) -> void {
+    u64 cycles = read_cycle_counter() - timer->start_cycles;
+
+    ProfileCallSite* site = &global_profiler->call_sites[timer->call_site];
+    // SDL has no 64-bit atomic add; these are plain relaxed counters.
+    __atomic_fetch_add(&site->hit_count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&site->cycles, cycles, __ATOMIC_RELAXED);
+
+    record_profile_event(timer->call_site, ProfileEventEnd);
+}
+
+// Closes the current frame and recycles the oldest one. Callers must make sure
+// no other thread is still inside a TIMED_BLOCK for the frame being closed.
+inline fn end_profile_frame(u64 frame_ns) -> void {
+    u32 index = SDL_GetAtomicInt(&global_profiler->frame_index);
+    ProfileFrame* frame = &global_profiler->frames[index];
+    frame->end_clock = SDL_GetPerformanceCounter();
+    frame->frame_ns = frame_ns;
+
+    u32 next_index = (index + 1) % PROFILE_FRAME_COUNT;
+    ProfileFrame* next_frame = &global_profiler->frames[next_index];
+    next_frame->begin_clock = frame->end_clock;
+    next_frame->frame_ns = 0;
+    SDL_SetAtomicInt(&next_frame->event_count, 0);
+    SDL_SetAtomicInt(&next_frame->dropped_count, 0);
+
+    SDL_SetAtomicInt(&global_profiler->frame_index, next_index);
+    // The slot being recorded into is never exported, so the ring holds at
+    // most PROFILE_FRAME_COUNT - 1 completed frames.
+    global_profiler->frames_recorded = SDL_min(
+        global_profiler->frames_recorded + 1,
+        (u32)PROFILE_FRAME_COUNT - 1
+    );
+}
+
+// Forgets call sites from first up, along with their buffered events, so
+// nothing is left pointing at names in code about to be unloaded. No other
+// thread may be inside a TIMED_BLOCK.
+inline fn retire_profile_call_sites(i32 first) -> void {
+    for (i32 i = first; i < MAX_PROFILE_CALL_SITES; ++i) {
+        global_profiler->call_sites[i] = {};
+    }
+
+    for (ProfileFrame& frame : global_profiler->frames) {
+        u32 event_count = SDL_min(
+            (u32)SDL_GetAtomicInt(&frame.event_count),
+            MAX_PROFILE_EVENTS_PER_FRAME
+        );
+
+        u32 kept = 0;
+        for (u32 i = 0; i < event_count; ++i) {
+            if (frame.events[i].call_site < first) {
+                frame.events[kept++] = frame.events[i];
+            }
+        }
+        SDL_SetAtomicInt(&frame.event_count, (int)kept);
+    }
+}
+
+struct TraceWriter {
+    SDL_IOStream* file;
+    usize used;
+    bool failed;
+    char buffer[KB(64)];
+
+    fn flush() -> void {
+        if (used && SDL_WriteIO(file, buffer, used) != used) {
+            failed = true;
+        }
+        used = 0;
+    }
+
+    fn append(const char* fmt, ...) -> void {
+        if (used > sizeof(buffer) - 512) {
+            flush();
+        }
+
+        va_list args;
+        va_start(args, fmt);
+        i32 written =
+            SDL_vsnprintf(buffer + used, sizeof(buffer) - used, fmt, args);
+        va_end(args);
+
+        used += SDL_clamp(written, 0, (i32)(sizeof(buffer) - used - 1));
+    }
+};
+
+// Exports the completed frames in the ring as Chrome trace JSON.
+inline fn write_profile_trace(const char* filename) -> bool {
+    SDL_IOStream* file = SDL_IOFromFile(filename, "wb");
+    if (!file) {
+        SDL_Log("Failed to create file %s: %s", filename, SDL_GetError());
+        return false;
+    }
+    defer { SDL_CloseIO(file); };
+
+    static TraceWriter writer;
+    writer.file = file;
+    writer.used = 0;
+    writer.failed = false;
+
+    u32 current = SDL_GetAtomicInt(&global_profiler->frame_index);
+    u32 frame_count = global_profiler->frames_recorded;
+    u32 oldest = (current + PROFILE_FRAME_COUNT - frame_count) %
+                 PROFILE_FRAME_COUNT;
+
+    // The very first frame has no previous frame end to start from.
+    ProfileFrame* oldest_frame = &global_profiler->frames[oldest];
+    u64 base_clock = oldest_frame->begin_clock;
+    if (!base_clock && SDL_GetAtomicInt(&oldest_frame->event_count) > 0) {
+        base_clock = oldest_frame->events[0].clock;
+        oldest_frame->begin_clock = base_clock;
+    }
+    f64 us_per_tick = 1000000.0 / (f64)SDL_GetPerformanceFrequency();
+
+    writer.append("{\"traceEvents\": [\n");
+    writer.append(
+        "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 0, "
+        "\"args\": {\"name\": \"handmade\"}}"
+    );
+
+    for (u32 i = 0; i < frame_count; ++i) {
+        ProfileFrame* frame =
+            &global_profiler->frames[(oldest + i) % PROFILE_FRAME_COUNT];
+        u32 event_count = SDL_min(
+            (u32)SDL_GetAtomicInt(&frame->event_count),
+            MAX_PROFILE_EVENTS_PER_FRAME
+        );
+
+        writer.append(
+            ",\n{\"name\": \"frame_ms\", \"ph\": \"C\", \"pid\": 0, "
+            "\"ts\": %.3f, \"args\": {\"frame_ms\": %.4f}}",
+            (f64)(frame->begin_clock - base_clock) * us_per_tick,
+            frame->frame_ns / 1000000.0
+        );
+
+        for (u32 event_index = 0; event_index < event_count; ++event_index) {
+            ProfileEvent* event = &frame->events[event_index];
+            ProfileCallSite* site =
+                &global_profiler->call_sites[event->call_site];
+
+            writer.append(
+                ",\n{\"name\": \"%s\", \"ph\": \"%s\", \"pid\": 0, "
+                "\"tid\": %u, \"ts\": %.3f}",
+                site->name,
+                event->type == ProfileEventBegin ? "B" : "E",
+                event->thread_id,
+                (f64)(event->clock - base_clock) * us_per_tick
+            );
+        }
+    }
+
+    writer.append("\n]}\n");
+    writer.flush();
+
+    if (writer.failed) {
+        SDL_Log("Failed to write complete data to file");
+        return false;
+    }
+
+    SDL_Log("Wrote %u profiled frames to %s", frame_count, filename);
+    return true;
+}
+
+// Logs the accumulated per-call-site totals.
+inline fn log_profile_call_sites() -> void {
+    for (i32 i = 0; i < MAX_PROFILE_CALL_SITES; ++i) {
+        ProfileCallSite* site = &global_profiler->call_sites[i];
+        u64 hit_count = __atomic_load_n(&site->hit_count, __ATOMIC_RELAXED);
+        if (!hit_count)
+            continue;
+
+        u64 cycles = __atomic_load_n(&site->cycles, __ATOMIC_RELAXED);
+        SDL_Log(
+            "%-24s %10" SDL_PRIu64 " hits %14" SDL_PRIu64
+            " cycles %12" SDL_PRIu64 " cy/hit  (%s:%d)",
+            site->name,
+            hit_count,
+            cycles,
+            cycles / hit_count,
+            site->file,
+            site->line
+        );
+    }
+}
+
+#define __timed_block(name, counter)                                           \
+    static_assert(                                                             \
+        PROFILE_CALL_SITE_BASE + (counter) < MAX_PROFILE_CALL_SITES            \
+    );                                                                         \
+    ProfileTimer profile_timer_##counter = begin_profile_block(                \
+        PROFILE_CALL_SITE_BASE + (counter),                                    \
+        (name),                                                                \
+        __FILE__,                                                              \
+        __LINE__                                                               \
+    );                                                                         \
+    auto profile_defer_##counter = defer_dummy() + [&]() {                     \
+        end_profile_block(&profile_timer_##counter);                           \
+    }
+#define _timed_block(name, counter) __timed_block(name, counter)
+
+#define TIMED_BLOCK(name) _timed_block(name, __COUNTER__)
+#define PROFILE_FRAME_END(frame_ns) end_profile_frame(frame_ns)
+#define PROFILE_WRITE_TRACE(filename) write_profile_trace(filename)
+#define PROFILE_LOG_CALL_SITES() log_profile_call_sites()
+#define PROFILE_INSTANCE() global_profiler
+#define PROFILE_USE(profiler) (global_profiler = (profiler))
+#define PROFILE_RETIRE_CALL_SITES(first) retire_profile_call_sites(first)
+
+#else
+
+#define TIMED_BLOCK(name)
+#define PROFILE_FRAME_END(frame_ns) ((void)(frame_ns))
+#define PROFILE_WRITE_TRACE(filename) ((void)(filename))
+#define PROFILE_LOG_CALL_SITES()
+#define PROFILE_INSTANCE() nullptr
+#define PROFILE_USE(profiler) ((void)(profiler))
+#define PROFILE_RETIRE_CALL_SITES(first) ((void)(first))
+
+#endif
@@ -0,0 +1,735 @@
+#pragma once
+
+#include "core.h"
+#include "render.h"
+
+// Software 2D drawing into an OffscreenBuffer. Colors and bitmaps are
+// premultiplied BGRA, a u32 of 0xAARRGGBB, and blend over the buffer as
+// src + dst * (255 - src_alpha) / 255. The buffer's own alpha byte is padding
+// and ends up holding whatever the blend leaves there.
+//
+// Positions are floats. Rect edges and bitmaps that don't land on whole
+// pixels are spread over the pixels they straddle: rects by coverage, bitmaps
+// by bilinear filtering against their transparent surroundings. Everything
+// is clipped to the buffer and to a caller's clip rect, so a render tile can
+// draw only its own pixels.
+//
+// The row loops are SSE2 or NEON, which are part of the x86-64 and arm64
+// baselines, with scalar fallbacks. Every wide loop must give results
+// bit-identical to its scalar reference; verify_raster_kernels() checks.
+
+struct Bitmap {
+    u32* pixels;
+    i32 width;
+    i32 height;
+    i32 pitch;
+    // Every pixel has alpha 255, so a whole-pixel draw is a straight copy.
+    bool is_opaque;
+};
+
+// Pixels in [min_x, max_x) x [min_y, max_y) may be written.
+struct ClipRect {
+    i32 min_x;
+    i32 min_y;
+    i32 max_x;
+    i32 max_y;
+};
+
+// Filter weights for the four source pixels around a destination pixel, in
+// 1/256ths that always add up to 256.
+struct BilinearWeights {
+    u16 w00;
+    u16 w10;
+    u16 w01;
+    u16 w11;
+};
+
+// Exact x / 255, rounded, for x up to 255 * 255.
+inline fn div255(u32 x) -> u32 {
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+inline fn blend_pixel(u32 src, u32 dst) -> u32 {
+    u32 inverse_alpha = 255 - (src >> 24);
+    u32 result = 0;
+
+    for (u32 shift = 0; shift < 32; shift += 8) {
+        u32 channel = ((src >> shift) & 0xFF) +
+                      div255(((dst >> shift) & 0xFF) * inverse_alpha);
+        result |= SDL_min(channel, 255u) << shift;
+    }
+
+    return result;
+}
+
+// Scales every channel by coverage/256.
+inline fn scale_color(u32 color, u32 coverage) -> u32 {
+    u32 result = 0;
+    for (u32 shift = 0; shift < 32; shift += 8) {
+        result |= ((((color >> shift) & 0xFF) * coverage) >> 8) << shift;
+    }
+    return result;
+}
+
+// p00 is the source pixel under the destination, p10 the one to its left,
+// p01 the one above it, p11 above and to the left.
+inline fn filter_pixel(
+    u32 p00,
+    u32 p10,
+    u32 p01,
+    u32 p11,
+    BilinearWeights weights
+) -> u32 {
+    u32 result = 0;
+    for (u32 shift = 0; shift < 32; shift += 8) {
+        u32 channel = ((p00 >> shift) & 0xFF) * weights.w00 +
+                      ((p10 >> shift) & 0xFF) * weights.w10 +
+                      ((p01 >> shift) & 0xFF) * weights.w01 +
+                      ((p11 >> shift) & 0xFF) * weights.w11;
+        result |= (channel >> 8) << shift;
+    }
+    return result;
+}
+
+static fn fill_row_scalar(u32* dst, i32 count, u32 color) -> void {
+    for (i32 i = 0; i < count; ++i) {
+        dst[i] = color;
+    }
+}
+
+static fn blend_color_row_scalar(u32* dst, i32 count, u32 color) -> void {
+    for (i32 i = 0; i < count; ++i) {
+        dst[i] = blend_pixel(color, dst[i]);
+    }
+}
+
+static fn blend_row_scalar(u32* dst, const u32* src, i32 count) -> void {
+    for (i32 i = 0; i < count; ++i) {
+        dst[i] = blend_pixel(src[i], dst[i]);
+    }
+}
+
+// Filters count pixels from two source rows; row0[-1] and row1[-1] are read,
+// so the caller handles a bitmap's left edge.
+static fn filter_row_scalar(
+    u32* dst,
+    const u32* row0,
+    const u32* row1,
+    i32 count,
+    BilinearWeights weights
+) -> void {
+    for (i32 i = 0; i < count; ++i) {
+        dst[i] = filter_pixel(
+            row0[i],
+            row0[i - 1],
+            row1[i],
+            row1[i - 1],
+            weights
+        );
+    }
+}
+
+#if defined(SDL_SSE2_INTRINSICS)
+
+static inline fn blend_over_sse2(__m128i src, __m128i dst) -> __m128i {
+    __m128i zero = _mm_setzero_si128();
+
+    __m128i alpha = _mm_srli_epi32(src, 24);
+    alpha = _mm_or_si128(alpha, _mm_slli_epi32(alpha, 8));
+    alpha = _mm_or_si128(alpha, _mm_slli_epi32(alpha, 16));
+    __m128i inverse_alpha = _mm_xor_si128(alpha, _mm_set1_epi32(-1));
+
+    let scale_half = [&](__m128i dst16, __m128i inverse16) {
+        __m128i x = _mm_mullo_epi16(dst16, inverse16);
+        x = _mm_add_epi16(x, _mm_set1_epi16(128));
+        return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+    };
+
+    __m128i low = scale_half(
+        _mm_unpacklo_epi8(dst, zero),
+        _mm_unpacklo_epi8(inverse_alpha, zero)
+    );
+    __m128i high = scale_half(
+        _mm_unpackhi_epi8(dst, zero),
+        _mm_unpackhi_epi8(inverse_alpha, zero)
+    );
+
+    return _mm_adds_epu8(src, _mm_packus_epi16(low, high));
+}
+
+static fn fill_row(u32* dst, i32 count, u32 color) -> void {
+    __m128i color4 = _mm_set1_epi32((i32)color);
+    i32 i = 0;
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_si128((__m128i*)(dst + i), color4);
+    }
+    fill_row_scalar(dst + i, count - i, color);
+}
+
+static fn blend_color_row(u32* dst, i32 count, u32 color) -> void {
+    __m128i color4 = _mm_set1_epi32((i32)color);
+    i32 i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i d = _mm_loadu_si128((__m128i*)(dst + i));
+        _mm_storeu_si128((__m128i*)(dst + i), blend_over_sse2(color4, d));
+    }
+    blend_color_row_scalar(dst + i, count - i, color);
+}
+
+static fn blend_row(u32* dst, const u32* src, i32 count) -> void {
+    __m128i alpha_mask = _mm_set1_epi32((i32)0xFF000000);
+    i32 i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i alpha = _mm_and_si128(s, alpha_mask);
+
+        // Sprites are mostly solid or empty; those skip the arithmetic.
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(alpha, alpha_mask)) == 0xFFFF) {
+            _mm_storeu_si128((__m128i*)(dst + i), s);
+        } else if (_mm_movemask_epi8(
+                       _mm_cmpeq_epi32(alpha, _mm_setzero_si128())
+                   ) != 0xFFFF) {
+            __m128i d = _mm_loadu_si128((__m128i*)(dst + i));
+            _mm_storeu_si128((__m128i*)(dst + i), blend_over_sse2(s, d));
+        }
+    }
+    blend_row_scalar(dst + i, src + i, count - i);
+}
+
+static fn filter_row(
+    u32* dst,
+    const u32* row0,
+    const u32* row1,
+    i32 count,
+    BilinearWeights weights
+) -> void {
+    __m128i zero = _mm_setzero_si128();
+    __m128i w00 = _mm_set1_epi16((i16)weights.w00);
+    __m128i w10 = _mm_set1_epi16((i16)weights.w10);
+    __m128i w01 = _mm_set1_epi16((i16)weights.w01);
+    __m128i w11 = _mm_set1_epi16((i16)weights.w11);
+
+    // Weights add up to 256, so the sums stay within 255 * 256.
+    let filter_half =
+        [&](__m128i p00, __m128i p10, __m128i p01, __m128i p11) {
+            __m128i sum = _mm_mullo_epi16(p00, w00);
+            sum = _mm_add_epi16(sum, _mm_mullo_epi16(p10, w10));
+            sum = _mm_add_epi16(sum, _mm_mullo_epi16(p01, w01));
+            sum = _mm_add_epi16(sum, _mm_mullo_epi16(p11, w11));
+            return _mm_srli_epi16(sum, 8);
+        };
+
+    i32 i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i p00 = _mm_loadu_si128((const __m128i*)(row0 + i));
+        __m128i p10 = _mm_loadu_si128((const __m128i*)(row0 + i - 1));
+        __m128i p01 = _mm_loadu_si128((const __m128i*)(row1 + i));
+        __m128i p11 = _mm_loadu_si128((const __m128i*)(row1 + i - 1));
+
+        __m128i low = filter_half(
+            _mm_unpacklo_epi8(p00, zero),
+            _mm_unpacklo_epi8(p10, zero),
+            _mm_unpacklo_epi8(p01, zero),
+            _mm_unpacklo_epi8(p11, zero)
+        );
+        __m128i high = filter_half(
+            _mm_unpackhi_epi8(p00, zero),
+            _mm_unpackhi_epi8(p10, zero),
+            _mm_unpackhi_epi8(p01, zero),
+            _mm_unpackhi_epi8(p11, zero)
+        );
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(low, high));
+    }
+    filter_row_scalar(dst + i, row0 + i, row1 + i, count - i, weights);
+}
+
+#elif defined(SDL_NEON_INTRINSICS)
+
+static inline fn blend_over_neon(uint32x4_t src, uint32x4_t dst)
+    -> uint32x4_t {
+    uint32x4_t alpha = vshrq_n_u32(src, 24);
+    alpha = vorrq_u32(alpha, vshlq_n_u32(alpha, 8));
+    alpha = vorrq_u32(alpha, vshlq_n_u32(alpha, 16));
+    uint8x16_t inverse_alpha = vmvnq_u8(vreinterpretq_u8_u32(alpha));
+    uint8x16_t d = vreinterpretq_u8_u32(dst);
+
+    let scale_half = [](uint8x8_t dst8, uint8x8_t inverse8) {
+        uint16x8_t x = vaddq_u16(vmull_u8(dst8, inverse8), vdupq_n_u16(128));
+        return vshrn_n_u16(vaddq_u16(x, vshrq_n_u16(x, 8)), 8);
+    };
+
+    uint8x16_t scaled = vcombine_u8(
+        scale_half(vget_low_u8(d), vget_low_u8(inverse_alpha)),
+        scale_half(vget_high_u8(d), vget_high_u8(inverse_alpha))
+    );
+
+    return vreinterpretq_u32_u8(
+        vqaddq_u8(vreinterpretq_u8_u32(src), scaled)
+    );
+}
+
+static fn fill_row(u32* dst, i32 count, u32 color) -> void {
+    uint32x4_t color4 = vdupq_n_u32(color);
+    i32 i = 0;
+    for (; i + 4 <= count; i += 4) {
+        vst1q_u32(dst + i, color4);
+    }
+    fill_row_scalar(dst + i, count - i, color);
+}
+
+static fn blend_color_row(u32* dst, i32 count, u32 color) -> void {
+    uint32x4_t color4 = vdupq_n_u32(color);
+    i32 i = 0;
+    for (; i + 4 <= count; i += 4) {
+        vst1q_u32(dst + i, blend_over_neon(color4, vld1q_u32(dst + i)));
+    }
+    blend_color_row_scalar(dst + i, count - i, color);
+}
+
+static fn blend_row(u32* dst, const u32* src, i32 count) -> void {
+    i32 i = 0;
+    for (; i + 4 <= count; i += 4) {
+        uint32x4_t s = vld1q_u32(src + i);
+        uint32x4_t alpha = vshrq_n_u32(s, 24);
+
+        if (vminvq_u32(alpha) == 255) {
+            vst1q_u32(dst + i, s);
+        } else if (vmaxvq_u32(alpha) != 0) {
+            vst1q_u32(dst + i, blend_over_neon(s, vld1q_u32(dst + i)));
+        }
+    }
+    blend_row_scalar(dst + i, src + i, count - i);
+}
+
+static fn filter_row(
+    u32* dst,
+    const u32* row0,
+    const u32* row1,
+    i32 count,
+    BilinearWeights weights
+) -> void {
+    let filter_half = [&](uint8x8_t p00,
+                          uint8x8_t p10,
+                          uint8x8_t p01,
+                          uint8x8_t p11) {
+        uint16x8_t sum = vmulq_n_u16(vmovl_u8(p00), weights.w00);
+        sum = vmlaq_n_u16(sum, vmovl_u8(p10), weights.w10);
+        sum = vmlaq_n_u16(sum, vmovl_u8(p01), weights.w01);
+        sum = vmlaq_n_u16(sum, vmovl_u8(p11), weights.w11);
+        return vshrn_n_u16(sum, 8);
+    };
+
+    i32 i = 0;
+    for (; i + 4 <= count; i += 4) {
+        uint8x16_t p00 = vreinterpretq_u8_u32(vld1q_u32(row0 + i));
+        uint8x16_t p10 = vreinterpretq_u8_u32(vld1q_u32(row0 + i - 1));
+        uint8x16_t p01 = vreinterpretq_u8_u32(vld1q_u32(row1 + i));
+        uint8x16_t p11 = vreinterpretq_u8_u32(vld1q_u32(row1 + i - 1));
+
+        uint8x16_t result = vcombine_u8(
+            filter_half(
+                vget_low_u8(p00),
+                vget_low_u8(p10),
+                vget_low_u8(p01),
+                vget_low_u8(p11)
+            ),
+            filter_half(
+                vget_high_u8(p00),
+                vget_high_u8(p10),
+                vget_high_u8(p01),
+                vget_high_u8(p11)
+            )
+        );
+        vst1q_u32(dst + i, vreinterpretq_u32_u8(result));
+    }
+    filter_row_scalar(dst + i, row0 + i, row1 + i, count - i, weights);
+}
+
+#else
+
+static fn fill_row(u32* dst, i32 count, u32 color) -> void {
+    fill_row_scalar(dst, count, color);
+}
+
+static fn blend_color_row(u32* dst, i32 count, u32 color) -> void {
+    blend_color_row_scalar(dst, count, color);
+}
+
+static fn blend_row(u32* dst, const u32* src, i32 count) -> void {
+    blend_row_scalar(dst, src, count);
+}
+
+static fn filter_row(
+    u32* dst,
+    const u32* row0,
+    const u32* row1,
+    i32 count,
+    BilinearWeights weights
+) -> void {
+    filter_row_scalar(dst, row0, row1, count, weights);
+}
+
+#endif
+
+fn buffer_clip_rect(OffscreenBuffer* buffer) -> ClipRect {
+    return ClipRect{0, 0, buffer->width, buffer->height};
+}
+
+static fn intersect_clip_rect(OffscreenBuffer* buffer, ClipRect clip)
+    -> ClipRect {
+    return ClipRect{
+        SDL_max(clip.min_x, 0),
+        SDL_max(clip.min_y, 0),
+        SDL_min(clip.max_x, buffer->width),
+        SDL_min(clip.max_y, buffer->height),
+    };
+}
+
+static fn buffer_row(OffscreenBuffer* buffer, i32 y) -> u32* {
+    return (u32*)(buffer->memory + y * buffer->pitch);
+}
+
+// Sets every pixel in clip to color, alpha and all.
+fn clear_rect(OffscreenBuffer* buffer, ClipRect clip, u32 color) -> void {
+    clip = intersect_clip_rect(buffer, clip);
+    if (clip.min_x >= clip.max_x)
+        return;
+
+    for (i32 y = clip.min_y; y < clip.max_y; ++y) {
+        fill_row(
+            buffer_row(buffer, y) + clip.min_x,
+            clip.max_x - clip.min_x,
+            color
+        );
+    }
+}
+
+// How much of the pixel starting at p lies inside [min, max), in 1/256ths.
+static fn pixel_coverage(i32 p, f32 min, f32 max) -> u32 {
+    f32 covered = SDL_min(max, (f32)(p + 1)) - SDL_max(min, (f32)p);
+    return (u32)(SDL_clamp(covered, 0.0f, 1.0f) * 256.0f + 0.5f);
+}
+
+// Fills [min_x, max_x) x [min_y, max_y) with color. Pixels the edges only
+// partly cover get the color scaled by how much of them is covered.
+fn draw_rect(
+    OffscreenBuffer* buffer,
+    ClipRect clip,
+    f32 min_x,
+    f32 min_y,
+    f32 max_x,
+    f32 max_y,
+    u32 color
+) -> void {
+    clip = intersect_clip_rect(buffer, clip);
+    if (!(min_x < max_x && min_y < max_y) || (color >> 24) == 0)
+        return;
+
+    // Pixels the rect touches at all, then the ones it covers completely.
+    i32 touched_min_x = (i32)SDL_floorf(min_x);
+    i32 touched_max_x = (i32)SDL_ceilf(max_x);
+    i32 touched_min_y = SDL_max((i32)SDL_floorf(min_y), clip.min_y);
+    i32 touched_max_y = SDL_min((i32)SDL_ceilf(max_y), clip.max_y);
+    i32 full_min_x = (i32)SDL_ceilf(min_x);
+    i32 full_max_x = (i32)SDL_floorf(max_x);
+
+    i32 run_min_x = SDL_max(full_min_x, clip.min_x);
+    i32 run_max_x = SDL_min(full_max_x, clip.max_x);
+
+    for (i32 y = touched_min_y; y < touched_max_y; ++y) {
+        u32* row = buffer_row(buffer, y);
+        u32 coverage_y = pixel_coverage(y, min_y, max_y);
+        u32 row_color = coverage_y >= 256 ? color
+                                          : scale_color(color, coverage_y);
+
+        if (run_min_x < run_max_x) {
+            if ((row_color >> 24) == 255) {
+                fill_row(row + run_min_x, run_max_x - run_min_x, row_color);
+            } else {
+                blend_color_row(
+                    row + run_min_x,
+                    run_max_x - run_min_x,
+                    row_color
+                );
+            }
+        }
+
+        // At most one partly covered column on each side, or a single one
+        // when the rect is thinner than a pixel.
+        let blend_edge = [&](i32 x) {
+            if (x < clip.min_x || x >= clip.max_x)
+                return;
+            u32 coverage_x = pixel_coverage(x, min_x, max_x);
+            row[x] = blend_pixel(scale_color(row_color, coverage_x), row[x]);
+        };
+        if (touched_min_x < full_min_x || touched_min_x >= full_max_x) {
+            blend_edge(touched_min_x);
+        }
+        if (touched_max_x - 1 >= full_max_x &&
+            touched_max_x - 1 > touched_min_x) {
+            blend_edge(touched_max_x - 1);
+        }
+    }
+}
+
+static fn bitmap_row(Bitmap* bitmap, i32 y) -> u32* {
+    return (u32*)((u8*)bitmap->pixels + y * bitmap->pitch);
+}
+
+// Draws bitmap with its top-left corner at (x, y). A bitmap off the pixel
+// grid covers one more column and row than its size, its edges fading out.
+// Each of its rows is filtered into a row from scratch and blended from
+// there; scratch is back at its old mark on return.
+fn draw_bitmap(
+    OffscreenBuffer* buffer,
+    ClipRect clip,
+    Bitmap* bitmap,
+    f32 x,
+    f32 y,
+    FixedBufferAllocator* scratch
+) -> void {
+    clip = intersect_clip_rect(buffer, clip);
+    if (bitmap->width <= 0 || bitmap->height <= 0)
+        return;
+
+    f32 floor_x = SDL_floorf(x);
+    f32 floor_y = SDL_floorf(y);
+    i32 origin_x = (i32)floor_x;
+    i32 origin_y = (i32)floor_y;
+    u32 fraction_x = (u32)((x - floor_x) * 256.0f + 0.5f);
+    u32 fraction_y = (u32)((y - floor_y) * 256.0f + 0.5f);
+    if (fraction_x == 256) {
+        origin_x += 1;
+        fraction_x = 0;
+    }
+    if (fraction_y == 256) {
+        origin_y += 1;
+        fraction_y = 0;
+    }
+
+    bool on_grid = fraction_x == 0 && fraction_y == 0;
+    i32 extent_x = bitmap->width + (on_grid ? 0 : 1);
+    i32 extent_y = bitmap->height + (on_grid ? 0 : 1);
+
+    // The covered part of the bitmap, in bitmap coordinates.
+    i32 min_u = SDL_max(clip.min_x - origin_x, 0);
+    i32 min_v = SDL_max(clip.min_y - origin_y, 0);
+    i32 max_u = SDL_min(clip.max_x - origin_x, extent_x);
+    i32 max_v = SDL_min(clip.max_y - origin_y, extent_y);
+    if (min_u >= max_u || min_v >= max_v)
+        return;
+
+    if (on_grid) {
+        for (i32 v = min_v; v < max_v; ++v) {
+            u32* dst = buffer_row(buffer, origin_y + v) + origin_x + min_u;
+            u32* src = bitmap_row(bitmap, v) + min_u;
+            if (bitmap->is_opaque) {
+                memcpy(dst, src, (usize)(max_u - min_u) * sizeof(u32));
+            } else {
+                blend_row(dst, src, max_u - min_u);
+            }
+        }
+        return;
+    }
+
+    u32 w00 = ((256 - fraction_x) * (256 - fraction_y)) >> 8;
+    u32 w10 = (fraction_x * (256 - fraction_y)) >> 8;
+    u32 w01 = ((256 - fraction_x) * fraction_y) >> 8;
+    BilinearWeights weights = {
+        (u16)w00,
+        (u16)w10,
+        (u16)w01,
+        (u16)(256 - w00 - w10 - w01),
+    };
+
+    TemporaryMemory temp = begin_temporary_memory(scratch);
+    defer { end_temporary_memory(temp); };
+    u32* filtered = scratch->alloc<u32>(max_u - min_u);
+    if (!filtered)
+        return;
+
+    for (i32 v = min_v; v < max_v; ++v) {
+        // Rows above and below the bitmap are transparent: drop their weights
+        // and point them at a real row so the loads stay in bounds.
+        BilinearWeights row_weights = weights;
+        const u32* row0 = v < bitmap->height ? bitmap_row(bitmap, v) : nullptr;
+        const u32* row1 = v > 0 ? bitmap_row(bitmap, v - 1) : nullptr;
+        if (!row0) {
+            row0 = row1;
+            row_weights.w00 = row_weights.w10 = 0;
+        }
+        if (!row1) {
+            row1 = row0;
+            row_weights.w01 = row_weights.w11 = 0;
+        }
+
+        i32 u = min_u;
+
+        // Columns 0 and width have a transparent neighbour on one side.
+        if (u == 0) {
+            filtered[0] = filter_pixel(row0[0], 0, row1[0], 0, row_weights);
+            u += 1;
+        }
+        i32 interior_end = SDL_min(max_u, bitmap->width);
+        if (u < interior_end) {
+            filter_row(
+                filtered + (u - min_u),
+                row0 + u,
+                row1 + u,
+                interior_end - u,
+                row_weights
+            );
+            u = interior_end;
+        }
+        if (u < max_u) {
+            i32 last = bitmap->width - 1;
+            filtered[u - min_u] =
+                filter_pixel(0, row0[last], 0, row1[last], row_weights);
+        }
+
+        u32* dst = buffer_row(buffer, origin_y + v) + origin_x;
+        blend_row(dst + min_u, filtered, max_u - min_u);
+    }
+}
+
+// Copies a BMP into arena as premultiplied BGRA.
+fn load_bitmap(const char* filename, FixedBufferAllocator* arena)
+    -> std::expected<Bitmap, FileError> {
+    SDL_Surface* loaded = SDL_LoadBMP(filename);
+    if (!loaded) {
+        SDL_Log("Failed to load bitmap %s: %s", filename, SDL_GetError());
+        return std::unexpected(InvalidFile);
+    }
+    defer { SDL_DestroySurface(loaded); };
+
+    SDL_Surface* surface = SDL_ConvertSurface(loaded, SDL_PIXELFORMAT_ARGB8888);
+    if (!surface) {
+        SDL_Log("Failed to convert bitmap %s: %s", filename, SDL_GetError());
+        return std::unexpected(ReadFailed);
+    }
+    defer { SDL_DestroySurface(surface); };
+
+    Bitmap bitmap = {};
+    bitmap.width = surface->w;
+    bitmap.height = surface->h;
+    bitmap.pitch = surface->w * (i32)sizeof(u32);
+    bitmap.pixels = (u32*)arena->alloc_bytes(
+        (usize)bitmap.pitch * bitmap.height,
+        64
+    );
+    if (!bitmap.pixels) {
+        return std::unexpected(AllocationFailed);
+    }
+
+    bitmap.is_opaque = true;
+    for (i32 y = 0; y < bitmap.height; ++y) {
+        u32* src = (u32*)((u8*)surface->pixels + y * surface->pitch);
+        u32* dst = bitmap_row(&bitmap, y);
+        for (i32 x = 0; x < bitmap.width; ++x) {
+            u32 alpha = src[x] >> 24;
+            u32 color = src[x] & 0x00FFFFFF;
+            if (alpha < 255) {
+                bitmap.is_opaque = false;
+                color = 0;
+                for (u32 shift = 0; shift < 24; shift += 8) {
+                    color |= div255(((src[x] >> shift) & 0xFF) * alpha)
+                             << shift;
+                }
+            }
+            dst[x] = (alpha << 24) | color;
+        }
+    }
+
+    return bitmap;
+}
+
+// Checks the wide row loops against the scalar ones, on odd counts so both
+// the wide loop and the tail run, and on colors covering every alpha class.
+// Logs the first pixel each loop gets wrong.
+fn verify_raster_kernels() -> bool {
+    constexpr i32 COUNT = 67;
+
+    u32 src[COUNT + 1];
+    u32 other[COUNT + 1];
+    u32 dst[COUNT];
+    u32 expected[COUNT];
+    u32 actual[COUNT];
+
+    u32 seed = 0xB1E4D;
+    let random_pixel = [&]() {
+        seed = seed * 1664525u + 1013904223u;
+        u32 alpha = (seed >> 16) & 0xFF;
+        switch (seed >> 30) {
+            case 0: {
+                alpha = 0;
+                break;
+            }
+            case 1: {
+                alpha = 255;
+                break;
+            }
+        }
+
+        u32 color = 0;
+        for (u32 shift = 0; shift < 24; shift += 8) {
+            color |= ((((seed >> shift) & 0xFF) * alpha) / 255) << shift;
+        }
+        return (alpha << 24) | color;
+    };
+
+    for (i32 i = 0; i < COUNT + 1; ++i) {
+        src[i] = random_pixel();
+        other[i] = random_pixel();
+    }
+    for (i32 i = 0; i < COUNT; ++i) {
+        dst[i] = random_pixel();
+    }
+
+    bool all_match = true;
+    let check = [&](const char* name) {
+        i32 mismatch = first_pixel_mismatch(expected, actual, COUNT);
+        if (mismatch >= 0) {
+            SDL_Log(
+                "Raster kernel %s disagrees with scalar at pixel %d: "
+                "%08x instead of %08x",
+                name,
+                mismatch,
+                actual[mismatch],
+                expected[mismatch]
+            );
+            all_match = false;
+        }
+    };
+
+    memcpy(expected, dst, sizeof(dst));
+    memcpy(actual, dst, sizeof(dst));
+    blend_row_scalar(expected, src + 1, COUNT);
+    blend_row(actual, src + 1, COUNT);
+    check("blend_row");
+
+    for (u32 color : {0x80402010u, 0xFF123456u, 0x01010101u}) {
+        memcpy(expected, dst, sizeof(dst));
+        memcpy(actual, dst, sizeof(dst));
+        blend_color_row_scalar(expected, COUNT, color);
+        blend_color_row(actual, COUNT, color);
+        check("blend_color_row");
+
+        fill_row_scalar(expected, COUNT, color);
+        fill_row(actual, COUNT, color);
+        check("fill_row");
+    }
+
+    const BilinearWeights weights[] = {
+        {256, 0, 0, 0},
+        {64, 64, 64, 64},
+        {3, 200, 50, 3},
+    };
+    for (BilinearWeights w : weights) {
+        filter_row_scalar(expected, src + 1, other + 1, COUNT, w);
+        filter_row(actual, src + 1, other + 1, COUNT, w);
+        check("filter_row");
+    }
+
+    return all_match;
+}
@@ -0,0 +1,322 @@
+#pragma once
+
+#include "core.h"
+
+struct OffscreenBuffer {
+    u8* memory;
+    i32 width;
+    i32 height;
+    i32 pitch;
+};
+
+// Plain memory bitmap in the same BGRX32 layout as the streaming texture, for
+// rendering without a window.
+fn create_offscreen_buffer(i32 width, i32 height) -> OffscreenBuffer {
+    OffscreenBuffer buffer = {};
+    buffer.width = width;
+    buffer.height = height;
+    buffer.pitch = width * sizeof(u32);
+    buffer.memory = (u8*)SDL_aligned_alloc(64, (usize)buffer.pitch * height);
+
+    if (!buffer.memory) {
+        SDL_Log("Buy more RAM lol!");
+        buffer = {};
+    }
+
+    return buffer;
+}
+
+fn destroy_offscreen_buffer(OffscreenBuffer* buffer) -> void {
+    SDL_aligned_free(buffer->memory);
+    *buffer = {};
+}
+
+// Fills the [min_x, max_x) x [min_y, max_y) region of the buffer with the
+// weird gradient. Every kernel must produce output bit-identical to
+// render_weird_gradient_scalar.
+typedef void GradientKernel(
+    OffscreenBuffer* buffer,
+    i32 min_x,
+    i32 min_y,
+    i32 max_x,
+    i32 max_y,
+    i32 blue_offset,
+    i32 green_offset
+);
+
+fn render_weird_gradient_scalar(
+    OffscreenBuffer* buffer,
+    i32 min_x,
+    i32 min_y,
+    i32 max_x,
+    i32 max_y,
+    i32 blue_offset,
+    i32 green_offset
+) -> void {
+    u8* row = buffer->memory + min_y * buffer->pitch + min_x * sizeof(u32);
+
+    for (i32 y = min_y; y < max_y; ++y) {
+        u32* pixel = (u32*)row;
+
+        for (i32 x = min_x; x < max_x; ++x) {
+            u8 blue = (x + blue_offset);
+            u8 green = (y + green_offset);
+
+            *pixel++ = ((green << 8) | blue);
+        }
+
+        row += buffer->pitch;
+    }
+}
+
+// The SIMD kernels keep a vector of (x + blue_offset) for the lanes and bump
+// it by the lane count, so the only per-pixel work is a mask and an or. The
+// green byte is constant across a row and gets splatted once per row.
+
+#ifdef SDL_SSE2_INTRINSICS
+SDL_TARGETING("sse2")
+fn render_weird_gradient_sse2(
+    OffscreenBuffer* buffer,
+    i32 min_x,
+    i32 min_y,
+    i32 max_x,
+    i32 max_y,
+    i32 blue_offset,
+    i32 green_offset
+) -> void {
+    u8* row = buffer->memory + min_y * buffer->pitch + min_x * sizeof(u32);
+    i32 wide_count = (max_x - min_x) / 4;
+
+    __m128i byte_mask = _mm_set1_epi32(0xFF);
+    __m128i lane_step = _mm_set1_epi32(4);
+    i32 blue_start = min_x + blue_offset;
+    __m128i blue_row = _mm_setr_epi32(
+        blue_start,
+        blue_start + 1,
+        blue_start + 2,
+        blue_start + 3
+    );
+
+    for (i32 y = min_y; y < max_y; ++y) {
+        u32* pixel = (u32*)row;
+
+        __m128i green = _mm_set1_epi32((u8)(y + green_offset) << 8);
+        __m128i blue = blue_row;
+
+        for (i32 i = 0; i < wide_count; ++i) {
+            __m128i color = _mm_or_si128(_mm_and_si128(blue, byte_mask), green);
+            _mm_storeu_si128((__m128i*)pixel, color);
+
+            blue = _mm_add_epi32(blue, lane_step);
+            pixel += 4;
+        }
+
+        for (i32 x = min_x + wide_count * 4; x < max_x; ++x) {
+            *pixel++ = ((u8)(y + green_offset) << 8) | (u8)(x + blue_offset);
+        }
+
+        row += buffer->pitch;
+    }
+}
+#endif
+
+#ifdef SDL_AVX2_INTRINSICS
+SDL_TARGETING("avx2")
+fn render_weird_gradient_avx2(
+    OffscreenBuffer* buffer,
+    i32 min_x,
+    i32 min_y,
+    i32 max_x,
+    i32 max_y,
+    i32 blue_offset,
+    i32 green_offset
+) -> void {
+    u8* row = buffer->memory + min_y * buffer->pitch + min_x * sizeof(u32);
+    i32 wide_count = (max_x - min_x) / 8;
+
+    __m256i byte_mask = _mm256_set1_epi32(0xFF);
+    __m256i lane_step = _mm256_set1_epi32(8);
+    i32 blue_start = min_x + blue_offset;
+    __m256i blue_row = _mm256_setr_epi32(
+        blue_start,
+        blue_start + 1,
+        blue_start + 2,
+        blue_start + 3,
+        blue_start + 4,
+        blue_start + 5,
+        blue_start + 6,
+        blue_start + 7
+    );
+
+    for (i32 y = min_y; y < max_y; ++y) {
+        u32* pixel = (u32*)row;
+
+        __m256i green = _mm256_set1_epi32((u8)(y + green_offset) << 8);
+        __m256i blue = blue_row;
+
+        for (i32 i = 0; i < wide_count; ++i) {
+            __m256i color =
+                _mm256_or_si256(_mm256_and_si256(blue, byte_mask), green);
+            _mm256_storeu_si256((__m256i*)pixel, color);
+
+            blue = _mm256_add_epi32(blue, lane_step);
+            pixel += 8;
+        }
+
+        for (i32 x = min_x + wide_count * 8; x < max_x; ++x) {
+            *pixel++ = ((u8)(y + green_offset) << 8) | (u8)(x + blue_offset);
+        }
+
+        row += buffer->pitch;
+    }
+}
+#endif
+
+#ifdef SDL_NEON_INTRINSICS
+fn render_weird_gradient_neon(
+    OffscreenBuffer* buffer,
+    i32 min_x,
+    i32 min_y,
+    i32 max_x,
+    i32 max_y,
+    i32 blue_offset,
+    i32 green_offset
+) -> void {
+    u8* row = buffer->memory + min_y * buffer->pitch + min_x * sizeof(u32);
+    i32 wide_count = (max_x - min_x) / 4;
+
+    uint32x4_t byte_mask = vdupq_n_u32(0xFF);
+    uint32x4_t lane_step = vdupq_n_u32(4);
+    u32 blue_start = (u32)(min_x + blue_offset);
+    const u32 lanes[4] = {0, 1, 2, 3};
+    uint32x4_t blue_row = vaddq_u32(vdupq_n_u32(blue_start), vld1q_u32(lanes));
+
+    for (i32 y = min_y; y < max_y; ++y) {
+        u32* pixel = (u32*)row;
+
+        uint32x4_t green = vdupq_n_u32((u32)(u8)(y + green_offset) << 8);
+        uint32x4_t blue = blue_row;
+
+        for (i32 i = 0; i < wide_count; ++i) {
+            uint32x4_t color = vorrq_u32(vandq_u32(blue, byte_mask), green);
+            vst1q_u32(pixel, color);
+
+            blue = vaddq_u32(blue, lane_step);
+            pixel += 4;
+        }
+
+        for (i32 x = min_x + wide_count * 4; x < max_x; ++x) {
+            *pixel++ = ((u8)(y + green_offset) << 8) | (u8)(x + blue_offset);
+        }
+
+        row += buffer->pitch;
+    }
+}
+#endif
+
+struct GradientKernelInfo {
+    const char* name;
+    GradientKernel* kernel;
+    bool (*is_supported)();
+};
+
+static fn always_supported() -> bool { return true; }
+
+// Ordered from most to least preferred.
+static const GradientKernelInfo GRADIENT_KERNELS[] = {
+#ifdef SDL_AVX2_INTRINSICS
+    {"avx2", render_weird_gradient_avx2, SDL_HasAVX2},
+#endif
+#ifdef SDL_SSE2_INTRINSICS
+    {"sse2", render_weird_gradient_sse2, SDL_HasSSE2},
+#endif
+#ifdef SDL_NEON_INTRINSICS
+    {"neon", render_weird_gradient_neon, SDL_HasNEON},
+#endif
+    {"scalar", render_weird_gradient_scalar, always_supported},
+};
+
+// Index of the first pixel that differs between expected and actual, or -1
+// when they match.
+fn first_pixel_mismatch(const u32* expected, const u32* actual, i32 count)
+    -> i32 {
+    for (i32 i = 0; i < count; ++i) {
+        if (expected[i] != actual[i])
+            return i;
+    }
+
+    return -1;
+}
+
+// Checks every kernel the CPU supports against the scalar reference on an
+// odd-sized region so both the wide loop and the scalar tail get exercised.
+// Logs the first pixel a kernel gets wrong.
+fn verify_gradient_kernels() -> bool {
+    constexpr i32 WIDTH = 67;
+    constexpr i32 HEIGHT = 5;
+    constexpr i32 PITCH = (WIDTH + 3) * sizeof(u32);
+
+    static u32 expected_pixels[HEIGHT * PITCH / sizeof(u32)];
+    static u32 actual_pixels[HEIGHT * PITCH / sizeof(u32)];
+
+    OffscreenBuffer expected = {(u8*)expected_pixels, WIDTH, HEIGHT, PITCH};
+    OffscreenBuffer actual = {(u8*)actual_pixels, WIDTH, HEIGHT, PITCH};
+
+    bool all_match = true;
+    const i32 offsets[] = {0, 3, -250, 1000003};
+
+    for (const GradientKernelInfo& info : GRADIENT_KERNELS) {
+        if (!info.is_supported())
+            continue;
+
+        for (i32 offset : offsets) {
+            memset(expected_pixels, 0, sizeof(expected_pixels));
+            memset(actual_pixels, 0, sizeof(actual_pixels));
+
+            render_weird_gradient_scalar(
+                &expected,
+                1,
+                1,
+                WIDTH,
+                HEIGHT,
+                offset,
+                -offset
+            );
+            info.kernel(&actual, 1, 1, WIDTH, HEIGHT, offset, -offset);
+
+            i32 mismatch = first_pixel_mismatch(
+                expected_pixels,
+                actual_pixels,
+                (i32)SDL_arraysize(actual_pixels)
+            );
+            if (mismatch >= 0) {
+                constexpr i32 ROW_PIXELS = PITCH / sizeof(u32);
+                SDL_Log(
+                    "Gradient kernel %s disagrees with scalar at (%d, %d), "
+                    "offset %d: %08x instead of %08x",
+                    info.name,
+                    mismatch % ROW_PIXELS,
+                    mismatch / ROW_PIXELS,
+                    offset,
+                    actual_pixels[mismatch],
+                    expected_pixels[mismatch]
+                );
+                all_match = false;
+                break;
+            }
+        }
+    }
+
+    return all_match;
+}
+
+// Picks the fastest kernel the CPU supports. Called once at startup.
+fn select_gradient_kernel() -> const GradientKernelInfo* {
+    for (const GradientKernelInfo& info : GRADIENT_KERNELS) {
+        if (info.is_supported()) {
+            return &info;
+        }
+    }
+
+    return &GRADIENT_KERNELS[SDL_arraysize(GRADIENT_KERNELS) - 1];
+}
@@ -0,0 +1,720 @@
+#pragma once
+
+#include "core.h"
+#include "profile.h"
+#include "rasterizer.h"
+#include "render.h"
+#include "work_queue.h"
+
+// The game describes each frame as a list of render commands and the platform
+// rasterizes them. Commands are plain values with no pointers into game
+// memory or game code (bitmaps point into the platform's asset pack), so the
+// platform can keep drawing one frame while the game updates the next, and
+// can unload the game library without waiting for the drawing to finish.
+//
+// Commands are packed back to back in one buffer, each a header followed by
+// its payload. The platform sorts them into screen tiles and each tile is one
+// work entry. A tile runs its commands in the order the game pushed them,
+// since blending depends on order. Commands that end up fully hidden under
+// a later clear, gradient or opaque rect are dropped from that tile.
+//
+// The platform also remembers a hash of what each tile of a buffer was last
+// drawn from, and of the texture it was last uploaded from. A tile whose
+// commands hash the same as last time still holds the right pixels, so it
+// is neither drawn nor uploaded again, and a frame where nothing changed
+// costs the sort and nothing else.
+
+constexpr i32 RENDER_TILE_SIZE = 64;
+constexpr i32 MAX_RENDER_TILES = WORK_QUEUE_CAPACITY - 1;
+constexpr i32 MAX_DAMAGE_RECTS = 64;
+
+enum RenderCommandType : u32 {
+    RenderCommandClear,
+    RenderCommandGradient,
+    RenderCommandRect,
+    RenderCommandBitmap,
+};
+
+struct RenderCommandHeader {
+    u32 type;
+    // Header included; the next command starts this many bytes on.
+    u32 size;
+};
+
+// Overwrites every pixel, ignoring alpha.
+struct RenderClear {
+    u32 color;
+};
+
+// The weird gradient, scrolled by the offsets; overwrites every pixel.
+struct RenderGradient {
+    i32 blue_offset;
+    i32 green_offset;
+};
+
+struct RenderRect {
+    f32 min_x;
+    f32 min_y;
+    f32 max_x;
+    f32 max_y;
+    u32 color;
+};
+
+struct RenderBitmap {
+    Bitmap bitmap;
+    f32 x;
+    f32 y;
+};
+
+struct RenderCommands {
+    // The size of the frame the commands were built for.
+    i32 width;
+    i32 height;
+
+    u8* base;
+    u32 capacity;
+    u32 used;
+    u32 command_count;
+};
+
+// Returns null, and drops the command, once the buffer is full.
+fn push_render_command(
+    RenderCommands* commands,
+    RenderCommandType type,
+    u32 payload_size
+) -> void* {
+    u32 size = (u32)sizeof(RenderCommandHeader) + ((payload_size + 7) & ~7u);
+    if (size > commands->capacity - commands->used) {
+        SDL_LogDebug(
+            SDL_LOG_CATEGORY_RENDER,
+            "Render command buffer of %u bytes is full",
+            commands->capacity
+        );
+        return nullptr;
+    }
+
+    RenderCommandHeader* header =
+        (RenderCommandHeader*)(commands->base + commands->used);
+    header->type = type;
+    header->size = size;
+
+    commands->used += size;
+    commands->command_count += 1;
+
+    return header + 1;
+}
+
+fn push_clear(RenderCommands* commands, u32 color) -> void {
+    RenderClear* clear = (RenderClear*)push_render_command(
+        commands,
+        RenderCommandClear,
+        sizeof(RenderClear)
+    );
+    if (clear) {
+        *clear = RenderClear{color};
+    }
+}
+
+fn push_gradient(RenderCommands* commands, i32 blue_offset, i32 green_offset)
+    -> void {
+    RenderGradient* gradient = (RenderGradient*)push_render_command(
+        commands,
+        RenderCommandGradient,
+        sizeof(RenderGradient)
+    );
+    if (gradient) {
+        *gradient = RenderGradient{blue_offset, green_offset};
+    }
+}
+
+fn push_rect(
+    RenderCommands* commands,
+    f32 min_x,
+    f32 min_y,
+    f32 max_x,
+    f32 max_y,
+    u32 color
+) -> void {
+    RenderRect* rect = (RenderRect*)push_render_command(
+        commands,
+        RenderCommandRect,
+        sizeof(RenderRect)
+    );
+    if (rect) {
+        *rect = RenderRect{min_x, min_y, max_x, max_y, color};
+    }
+}
+
+fn push_bitmap(RenderCommands* commands, Bitmap* bitmap, f32 x, f32 y)
+    -> void {
+    RenderBitmap* command = (RenderBitmap*)push_render_command(
+        commands,
+        RenderCommandBitmap,
+        sizeof(RenderBitmap)
+    );
+    if (command) {
+        *command = RenderBitmap{*bitmap, x, y};
+    }
+}
+
+// Platform side.
+
+struct RenderBatch;
+
+struct RenderTile {
+    RenderBatch* batch;
+    ClipRect clip;
+
+    // Offsets of this tile's commands in the command buffer, in push order.
+    u32* command_offsets;
+    u32 command_count;
+    // The last command known to cover the whole tile; nothing before it is
+    // drawn. Without one, the tile is cleared to black first.
+    u32 first_visible;
+    bool is_covered;
+
+    u64 elapsed_ticks;
+};
+
+// One frame's commands on their way through the render queue.
+struct RenderBatch {
+    RenderCommands* commands;
+    OffscreenBuffer* buffer;
+    GradientKernel* gradient_kernel;
+
+    RenderTile* tiles;
+    i32 tile_count;
+};
+
+struct RenderTimings {
+    u64 frame_count = 0;
+    u64 tile_count = 0;
+    u64 command_count = 0;
+    u64 total_ticks = 0;
+    u64 min_ticks = UINT64_MAX;
+    u64 max_ticks = 0;
+    u64 last_report_ns = 0;
+};
+
+// What each tile of a buffer, or of the texture it is uploaded to, was last
+// drawn from. A buffer is only ever compared with its own past, and the
+// texture with whichever buffer is shown next, so any number of buffers can
+// take turns.
+struct RenderDamage {
+    u64 tile_hashes[MAX_RENDER_TILES];
+    i32 width;
+    i32 height;
+    i32 tile_size;
+    i32 tile_count_x;
+    i32 tile_count_y;
+    bool is_valid;
+};
+
+// Call whenever the buffer's pixels change behind the render queue's back;
+// the next batch then draws and uploads every tile.
+fn invalidate_render_damage(RenderDamage* damage) -> void {
+    damage->is_valid = false;
+}
+
+// The pixels a command can touch, and whether it paints all of clip with
+// nothing showing through.
+static fn render_command_bounds(
+    RenderCommandHeader* header,
+    ClipRect clip,
+    bool* covers_clip
+) -> ClipRect {
+    *covers_clip = false;
+
+    switch (header->type) {
+        case RenderCommandClear:
+        case RenderCommandGradient: {
+            *covers_clip = true;
+            return clip;
+        }
+
+        case RenderCommandRect: {
+            RenderRect* rect = (RenderRect*)(header + 1);
+            *covers_clip = (rect->color >> 24) == 255 &&
+                           rect->min_x <= clip.min_x &&
+                           rect->min_y <= clip.min_y &&
+                           rect->max_x >= clip.max_x &&
+                           rect->max_y >= clip.max_y;
+            return ClipRect{
+                (i32)SDL_floorf(rect->min_x),
+                (i32)SDL_floorf(rect->min_y),
+                (i32)SDL_ceilf(rect->max_x),
+                (i32)SDL_ceilf(rect->max_y),
+            };
+        }
+
+        case RenderCommandBitmap: {
+            // Off the pixel grid a bitmap spills one pixel right and down.
+            RenderBitmap* command = (RenderBitmap*)(header + 1);
+            i32 min_x = (i32)SDL_floorf(command->x);
+            i32 min_y = (i32)SDL_floorf(command->y);
+            return ClipRect{
+                min_x,
+                min_y,
+                min_x + command->bitmap.width + 1,
+                min_y + command->bitmap.height + 1,
+            };
+        }
+    }
+
+    return ClipRect{};
+}
+
+static fn hash_render_word(u64 hash, u64 value) -> u64 {
+    hash ^= value * 0x9E3779B97F4A7C15ull;
+    hash = (hash << 31) | (hash >> 33);
+    return hash * 0xC2B2AE3D27D4EB4Full;
+}
+
+static fn hash_render_f32(u64 hash, f32 value) -> u64 {
+    u32 bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return hash_render_word(hash, bits);
+}
+
+// Hashes the fields rather than the bytes, so padding doesn't count.
+static fn hash_render_command(u64 hash, RenderCommandHeader* header) -> u64 {
+    hash = hash_render_word(hash, header->type);
+
+    switch (header->type) {
+        case RenderCommandClear: {
+            RenderClear* clear = (RenderClear*)(header + 1);
+            hash = hash_render_word(hash, clear->color);
+            break;
+        }
+
+        case RenderCommandGradient: {
+            RenderGradient* gradient = (RenderGradient*)(header + 1);
+            hash = hash_render_word(hash, (u32)gradient->blue_offset);
+            hash = hash_render_word(hash, (u32)gradient->green_offset);
+            break;
+        }
+
+        case RenderCommandRect: {
+            RenderRect* rect = (RenderRect*)(header + 1);
+            hash = hash_render_f32(hash, rect->min_x);
+            hash = hash_render_f32(hash, rect->min_y);
+            hash = hash_render_f32(hash, rect->max_x);
+            hash = hash_render_f32(hash, rect->max_y);
+            hash = hash_render_word(hash, rect->color);
+            break;
+        }
+
+        case RenderCommandBitmap: {
+            // Bitmaps live in the asset pack, which never changes under a
+            // running game, so the pixels pointer stands for their contents.
+            RenderBitmap* command = (RenderBitmap*)(header + 1);
+            hash = hash_render_word(hash, (u64)command->bitmap.pixels);
+            hash = hash_render_word(hash, (u32)command->bitmap.width);
+            hash = hash_render_word(hash, (u32)command->bitmap.height);
+            hash = hash_render_word(hash, (u32)command->bitmap.pitch);
+            hash = hash_render_word(hash, command->bitmap.is_opaque);
+            hash = hash_render_f32(hash, command->x);
+            hash = hash_render_f32(hash, command->y);
+            break;
+        }
+    }
+
+    return hash;
+}
+
+static fn hash_render_tile(RenderTile* tile) -> u64 {
+    RenderBatch* batch = tile->batch;
+    u64 hash =
+        hash_render_word(tile->command_count, (u64)batch->gradient_kernel);
+
+    for (u32 i = 0; i < tile->command_count; ++i) {
+        hash = hash_render_command(
+            hash,
+            (RenderCommandHeader*)(batch->commands->base +
+                                   tile->command_offsets[i])
+        );
+    }
+
+    return hash;
+}
+
+static fn render_tile_work(
+    [[maybe_unused]] WorkQueue* queue,
+    FixedBufferAllocator* scratch,
+    void* data
+) -> void {
+    TIMED_BLOCK("render_tile");
+    RenderTile* tile = (RenderTile*)data;
+    RenderBatch* batch = tile->batch;
+    OffscreenBuffer* buffer = batch->buffer;
+    ClipRect clip = tile->clip;
+
+    u64 start_ticks = SDL_GetPerformanceCounter();
+
+    // Left alone, the tile would keep whatever this buffer last held there,
+    // so its pixels would depend on more than its commands.
+    if (!tile->is_covered) {
+        clear_rect(buffer, clip, 0xFF000000);
+    }
+
+    for (u32 i = 0; i < tile->command_count; ++i) {
+        RenderCommandHeader* header =
+            (RenderCommandHeader*)(batch->commands->base +
+                                   tile->command_offsets[i]);
+
+        switch (header->type) {
+            case RenderCommandClear: {
+                RenderClear* clear = (RenderClear*)(header + 1);
+                clear_rect(buffer, clip, clear->color);
+                break;
+            }
+
+            case RenderCommandGradient: {
+                RenderGradient* gradient = (RenderGradient*)(header + 1);
+                batch->gradient_kernel(
+                    buffer,
+                    clip.min_x,
+                    clip.min_y,
+                    clip.max_x,
+                    clip.max_y,
+                    gradient->blue_offset,
+                    gradient->green_offset
+                );
+                break;
+            }
+
+            case RenderCommandRect: {
+                RenderRect* rect = (RenderRect*)(header + 1);
+                draw_rect(
+                    buffer,
+                    clip,
+                    rect->min_x,
+                    rect->min_y,
+                    rect->max_x,
+                    rect->max_y,
+                    rect->color
+                );
+                break;
+            }
+
+            case RenderCommandBitmap: {
+                RenderBitmap* command = (RenderBitmap*)(header + 1);
+                draw_bitmap(
+                    buffer,
+                    clip,
+                    &command->bitmap,
+                    command->x,
+                    command->y,
+                    scratch
+                );
+                break;
+            }
+        }
+    }
+
+    tile->elapsed_ticks = SDL_GetPerformanceCounter() - start_ticks;
+}
+
+// Sorts the commands into tiles, allocated from arena, and queues every tile
+// whose commands changed since damage last saw it. Returns without waiting:
+// arena, the commands and the buffer must stay untouched until
+// complete_all_work(queue) returns.
+fn begin_render_batch(
+    RenderBatch* batch,
+    WorkQueue* queue,
+    FixedBufferAllocator* arena,
+    RenderCommands* commands,
+    OffscreenBuffer* buffer,
+    GradientKernel* gradient_kernel,
+    RenderDamage* damage
+) -> bool {
+    TIMED_BLOCK("begin_render_batch");
+
+    *batch = RenderBatch{
+        .commands = commands,
+        .buffer = buffer,
+        .gradient_kernel = gradient_kernel,
+        .tiles = nullptr,
+        .tile_count = 0,
+    };
+
+    // Grow the tiles on absurdly large buffers rather than overflow the queue.
+    i32 tile_size = RENDER_TILE_SIZE;
+    i32 tile_count_x, tile_count_y;
+    for (;;) {
+        tile_count_x = (buffer->width + tile_size - 1) / tile_size;
+        tile_count_y = (buffer->height + tile_size - 1) / tile_size;
+        if (tile_count_x * tile_count_y <= MAX_RENDER_TILES)
+            break;
+        tile_size *= 2;
+    }
+
+    RenderTile* tiles = arena->alloc<RenderTile>(tile_count_x * tile_count_y);
+    if (!tiles) {
+        return false;
+    }
+
+    for (i32 tile_y = 0; tile_y < tile_count_y; ++tile_y) {
+        for (i32 tile_x = 0; tile_x < tile_count_x; ++tile_x) {
+            i32 min_x = tile_x * tile_size;
+            i32 min_y = tile_y * tile_size;
+            tiles[tile_y * tile_count_x + tile_x] = RenderTile{
+                .batch = batch,
+                .clip = {
+                    min_x,
+                    min_y,
+                    SDL_min(min_x + tile_size, buffer->width),
+                    SDL_min(min_y + tile_size, buffer->height),
+                },
+                .command_offsets = nullptr,
+                .command_count = 0,
+                .first_visible = 0,
+                .is_covered = false,
+                .elapsed_ticks = 0,
+            };
+        }
+    }
+
+    // Calls visit(tile, command_index, covers_tile) for every tile the
+    // command at offset touches.
+    let for_each_tile = [&](u32 offset, u32 command_index, auto visit) {
+        RenderCommandHeader* header =
+            (RenderCommandHeader*)(commands->base + offset);
+
+        bool covers_buffer;
+        ClipRect bounds = render_command_bounds(
+            header,
+            buffer_clip_rect(buffer),
+            &covers_buffer
+        );
+        bounds.min_x = SDL_max(bounds.min_x, 0);
+        bounds.min_y = SDL_max(bounds.min_y, 0);
+        bounds.max_x = SDL_min(bounds.max_x, buffer->width);
+        bounds.max_y = SDL_min(bounds.max_y, buffer->height);
+        if (bounds.min_x >= bounds.max_x || bounds.min_y >= bounds.max_y)
+            return;
+
+        for (i32 tile_y = bounds.min_y / tile_size;
+             tile_y <= (bounds.max_y - 1) / tile_size;
+             ++tile_y) {
+            for (i32 tile_x = bounds.min_x / tile_size;
+                 tile_x <= (bounds.max_x - 1) / tile_size;
+                 ++tile_x) {
+                RenderTile* tile = &tiles[tile_y * tile_count_x + tile_x];
+                bool covers_tile;
+                render_command_bounds(header, tile->clip, &covers_tile);
+                visit(tile, command_index, covers_tile);
+            }
+        }
+    };
+
+    // First pass: count each tile's commands from its last covering one on.
+    u32 command_index = 0;
+    for (u32 offset = 0; offset < commands->used;
+         offset += ((RenderCommandHeader*)(commands->base + offset))->size) {
+        for_each_tile(
+            offset,
+            command_index++,
+            [](RenderTile* tile, u32 index, bool covers_tile) {
+                if (covers_tile) {
+                    tile->first_visible = index;
+                    tile->is_covered = true;
+                    tile->command_count = 0;
+                }
+                tile->command_count += 1;
+            }
+        );
+    }
+
+    for (i32 i = 0; i < tile_count_x * tile_count_y; ++i) {
+        RenderTile* tile = &tiles[i];
+        tile->command_offsets = arena->alloc<u32>(tile->command_count);
+        if (tile->command_count && !tile->command_offsets) {
+            return false;
+        }
+        tile->command_count = 0;
+    }
+
+    // Second pass: fill in the offsets of the commands that survived.
+    command_index = 0;
+    for (u32 offset = 0; offset < commands->used;
+         offset += ((RenderCommandHeader*)(commands->base + offset))->size) {
+        for_each_tile(
+            offset,
+            command_index++,
+            [offset](RenderTile* tile, u32 index, bool) {
+                if (index >= tile->first_visible) {
+                    tile->command_offsets[tile->command_count++] = offset;
+                }
+            }
+        );
+    }
+
+    batch->tiles = tiles;
+    batch->tile_count = tile_count_x * tile_count_y;
+
+    if (!damage->is_valid || damage->width != buffer->width ||
+        damage->height != buffer->height) {
+        damage->width = buffer->width;
+        damage->height = buffer->height;
+        damage->tile_size = tile_size;
+        damage->tile_count_x = tile_count_x;
+        damage->tile_count_y = tile_count_y;
+
+        // Nothing can match, so every tile is drawn below.
+        for (i32 i = 0; i < batch->tile_count; ++i) {
+            damage->tile_hashes[i] = ~hash_render_tile(&tiles[i]);
+        }
+        damage->is_valid = true;
+    }
+
+    for (i32 i = 0; i < batch->tile_count; ++i) {
+        RenderTile* tile = &tiles[i];
+        u64 hash = hash_render_tile(tile);
+        if (hash == damage->tile_hashes[i]) {
+            // Already holds these pixels; not drawn, and not counted.
+            tile->command_count = 0;
+            continue;
+        }
+
+        // An empty tile is still queued, to be cleared.
+        damage->tile_hashes[i] = hash;
+        add_work_entry(queue, render_tile_work, tile);
+    }
+
+    return true;
+}
+
+// Collects the tiles where drawn differs from what shown holds into at most
+// max_rects rects, and marks them as shown. Runs of tiles along a row become
+// one rect, and a run lined up with one in the row above extends it
+// downwards. If that still takes too many, everything collapses into one
+// bounding rect.
+fn take_damage_rects(
+    RenderDamage* drawn,
+    RenderDamage* shown,
+    SDL_Rect* rects,
+    i32 max_rects
+) -> i32 {
+    if (!drawn->is_valid)
+        return 0;
+
+    // Nothing is known about the texture, so every tile goes up.
+    if (!shown->is_valid || shown->width != drawn->width ||
+        shown->height != drawn->height) {
+        shown->width = drawn->width;
+        shown->height = drawn->height;
+        shown->tile_size = drawn->tile_size;
+        shown->tile_count_x = drawn->tile_count_x;
+        shown->tile_count_y = drawn->tile_count_y;
+        for (i32 i = 0; i < drawn->tile_count_x * drawn->tile_count_y; ++i) {
+            shown->tile_hashes[i] = ~drawn->tile_hashes[i];
+        }
+        shown->is_valid = true;
+    }
+
+    i32 tile_size = drawn->tile_size;
+    i32 rect_count = 0;
+    bool overflowed = false;
+    SDL_Rect bounds = {};
+
+    for (i32 tile_y = 0; tile_y < drawn->tile_count_y; ++tile_y) {
+        u64* drawn_row = &drawn->tile_hashes[tile_y * drawn->tile_count_x];
+        u64* shown_row = &shown->tile_hashes[tile_y * drawn->tile_count_x];
+        i32 y = tile_y * tile_size;
+        i32 h = SDL_min(y + tile_size, drawn->height) - y;
+
+        for (i32 tile_x = 0; tile_x < drawn->tile_count_x;) {
+            if (drawn_row[tile_x] == shown_row[tile_x]) {
+                ++tile_x;
+                continue;
+            }
+
+            i32 run_start = tile_x;
+            while (tile_x < drawn->tile_count_x &&
+                   drawn_row[tile_x] != shown_row[tile_x]) {
+                shown_row[tile_x] = drawn_row[tile_x];
+                ++tile_x;
+            }
+
+            i32 x = run_start * tile_size;
+            SDL_Rect run = {
+                x,
+                y,
+                SDL_min(tile_x * tile_size, drawn->width) - x,
+                h,
+            };
+            SDL_GetRectUnion(&bounds, &run, &bounds);
+
+            bool merged = false;
+            for (i32 i = 0; i < rect_count && !merged; ++i) {
+                SDL_Rect* rect = &rects[i];
+                if (rect->x == run.x && rect->w == run.w &&
+                    rect->y + rect->h == run.y) {
+                    rect->h += run.h;
+                    merged = true;
+                }
+            }
+
+            if (!merged) {
+                if (rect_count < max_rects) {
+                    rects[rect_count++] = run;
+                } else {
+                    overflowed = true;
+                }
+            }
+        }
+    }
+
+    if (overflowed) {
+        rects[0] = bounds;
+        return 1;
+    }
+
+    return rect_count;
+}
+
+// Folds a finished batch's per-tile timings into the running stats and
+// reports them once a second. Enable with SDL_LOGGING="render=debug".
+fn record_render_timings(
+    RenderTimings* timings,
+    RenderBatch* batch,
+    i32 thread_count
+) -> void {
+    timings->frame_count += 1;
+
+    for (i32 i = 0; i < batch->tile_count; ++i) {
+        RenderTile* tile = &batch->tiles[i];
+        if (!tile->command_count)
+            continue;
+
+        u64 ticks = tile->elapsed_ticks;
+        timings->tile_count += 1;
+        timings->command_count += tile->command_count;
+        timings->total_ticks += ticks;
+        timings->min_ticks = SDL_min(timings->min_ticks, ticks);
+        timings->max_ticks = SDL_max(timings->max_ticks, ticks);
+    }
+
+    u64 now_ns = SDL_GetTicksNS();
+    if (now_ns - timings->last_report_ns < SDL_NS_PER_SECOND)
+        return;
+
+    if (timings->tile_count > 0) {
+        f64 us_per_tick = 1000000.0 / (f64)SDL_GetPerformanceFrequency();
+        SDL_LogDebug(
+            SDL_LOG_CATEGORY_RENDER,
+            "Tiles: %d threads, %.0f tiles/frame, %.1f commands/tile, "
+            "avg %.2f us, min %.2f us, max %.2f us",
+            thread_count,
+            (f64)timings->tile_count / (f64)timings->frame_count,
+            (f64)timings->command_count / (f64)timings->tile_count,
+            (f64)timings->total_ticks / (f64)timings->tile_count * us_per_tick,
+            (f64)timings->min_ticks * us_per_tick,
+            (f64)timings->max_ticks * us_per_tick
+        );
+    }
+
+    *timings = {};
+    timings->last_report_ns = now_ns;
+}
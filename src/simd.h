@@ -0,0 +1,171 @@
+#pragma once
+
+#include "core.h"
+
+// Four-wide float lanes over SSE2, NEON, or plain arrays. SSE2 is part of the
+// x86-64 baseline, so unlike the gradient kernels this needs no runtime
+// dispatch. Comparisons return all-ones/all-zeros lane masks for f32x4_select.
+
+#if defined(SDL_SSE2_INTRINSICS)
+
+struct f32x4 {
+    __m128 v;
+};
+
+inline fn f32x4_set1(f32 a) -> f32x4 { return {_mm_set1_ps(a)}; }
+inline fn f32x4_set(f32 a, f32 b, f32 c, f32 d) -> f32x4 {
+    return {_mm_setr_ps(a, b, c, d)};
+}
+inline fn f32x4_load(const f32* p) -> f32x4 { return {_mm_loadu_ps(p)}; }
+inline fn f32x4_store(f32* p, f32x4 a) -> void { _mm_storeu_ps(p, a.v); }
+
+inline fn operator+(f32x4 a, f32x4 b) -> f32x4 {
+    return {_mm_add_ps(a.v, b.v)};
+}
+inline fn operator-(f32x4 a, f32x4 b) -> f32x4 {
+    return {_mm_sub_ps(a.v, b.v)};
+}
+inline fn operator*(f32x4 a, f32x4 b) -> f32x4 {
+    return {_mm_mul_ps(a.v, b.v)};
+}
+
+inline fn f32x4_min(f32x4 a, f32x4 b) -> f32x4 {
+    return {_mm_min_ps(a.v, b.v)};
+}
+inline fn f32x4_max(f32x4 a, f32x4 b) -> f32x4 {
+    return {_mm_max_ps(a.v, b.v)};
+}
+
+inline fn f32x4_greater(f32x4 a, f32x4 b) -> f32x4 {
+    return {_mm_cmpgt_ps(a.v, b.v)};
+}
+inline fn f32x4_less(f32x4 a, f32x4 b) -> f32x4 {
+    return {_mm_cmplt_ps(a.v, b.v)};
+}
+
+// Lanes where mask is set take a, the rest take b.
+inline fn f32x4_select(f32x4 mask, f32x4 a, f32x4 b) -> f32x4 {
+    return {_mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v))};
+}
+
+inline fn f32x4_abs(f32x4 a) -> f32x4 {
+    return {_mm_andnot_ps(_mm_set1_ps(-0.0f), a.v)};
+}
+
+// SSE2 has no floor; truncate and step down wherever that rounded up.
+inline fn f32x4_floor(f32x4 a) -> f32x4 {
+    __m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(a.v));
+    __m128 too_big = _mm_cmpgt_ps(truncated, a.v);
+    return {_mm_sub_ps(truncated, _mm_and_ps(too_big, _mm_set1_ps(1.0f)))};
+}
+
+#elif defined(SDL_NEON_INTRINSICS)
+
+struct f32x4 {
+    float32x4_t v;
+};
+
+inline fn f32x4_set1(f32 a) -> f32x4 { return {vdupq_n_f32(a)}; }
+inline fn f32x4_set(f32 a, f32 b, f32 c, f32 d) -> f32x4 {
+    const f32 lanes[4] = {a, b, c, d};
+    return {vld1q_f32(lanes)};
+}
+inline fn f32x4_load(const f32* p) -> f32x4 { return {vld1q_f32(p)}; }
+inline fn f32x4_store(f32* p, f32x4 a) -> void { vst1q_f32(p, a.v); }
+
+inline fn operator+(f32x4 a, f32x4 b) -> f32x4 { return {vaddq_f32(a.v, b.v)}; }
+inline fn operator-(f32x4 a, f32x4 b) -> f32x4 { return {vsubq_f32(a.v, b.v)}; }
+inline fn operator*(f32x4 a, f32x4 b) -> f32x4 { return {vmulq_f32(a.v, b.v)}; }
+
+inline fn f32x4_min(f32x4 a, f32x4 b) -> f32x4 { return {vminq_f32(a.v, b.v)}; }
+inline fn f32x4_max(f32x4 a, f32x4 b) -> f32x4 { return {vmaxq_f32(a.v, b.v)}; }
+
+inline fn f32x4_greater(f32x4 a, f32x4 b) -> f32x4 {
+    return {vreinterpretq_f32_u32(vcgtq_f32(a.v, b.v))};
+}
+inline fn f32x4_less(f32x4 a, f32x4 b) -> f32x4 {
+    return {vreinterpretq_f32_u32(vcltq_f32(a.v, b.v))};
+}
+
+inline fn f32x4_select(f32x4 mask, f32x4 a, f32x4 b) -> f32x4 {
+    return {vbslq_f32(vreinterpretq_u32_f32(mask.v), a.v, b.v)};
+}
+
+inline fn f32x4_abs(f32x4 a) -> f32x4 { return {vabsq_f32(a.v)}; }
+
+inline fn f32x4_floor(f32x4 a) -> f32x4 {
+    float32x4_t truncated = vcvtq_f32_s32(vcvtq_s32_f32(a.v));
+    uint32x4_t too_big = vcgtq_f32(truncated, a.v);
+    float32x4_t one = vdupq_n_f32(1.0f);
+    return {vsubq_f32(
+        truncated,
+        vreinterpretq_f32_u32(vandq_u32(too_big, vreinterpretq_u32_f32(one)))
+    )};
+}
+
+#else
+
+struct f32x4 {
+    f32 v[4];
+};
+
+inline fn f32x4_set1(f32 a) -> f32x4 { return {{a, a, a, a}}; }
+inline fn f32x4_set(f32 a, f32 b, f32 c, f32 d) -> f32x4 {
+    return {{a, b, c, d}};
+}
+inline fn f32x4_load(const f32* p) -> f32x4 {
+    return {{p[0], p[1], p[2], p[3]}};
+}
+inline fn f32x4_store(f32* p, f32x4 a) -> void { memcpy(p, a.v, sizeof(a.v)); }
+
+#define F32X4_LANEWISE(expr)                                                   \
+    f32x4 result;                                                              \
+    for (i32 i = 0; i < 4; ++i) {                                              \
+        result.v[i] = (expr);                                                  \
+    }                                                                          \
+    return result
+
+inline fn operator+(f32x4 a, f32x4 b) -> f32x4 {
+    F32X4_LANEWISE(a.v[i] + b.v[i]);
+}
+inline fn operator-(f32x4 a, f32x4 b) -> f32x4 {
+    F32X4_LANEWISE(a.v[i] - b.v[i]);
+}
+inline fn operator*(f32x4 a, f32x4 b) -> f32x4 {
+    F32X4_LANEWISE(a.v[i] * b.v[i]);
+}
+
+inline fn f32x4_min(f32x4 a, f32x4 b) -> f32x4 {
+    F32X4_LANEWISE(SDL_min(a.v[i], b.v[i]));
+}
+inline fn f32x4_max(f32x4 a, f32x4 b) -> f32x4 {
+    F32X4_LANEWISE(SDL_max(a.v[i], b.v[i]));
+}
+
+// Scalar masks are 1.0f/0.0f rather than bit patterns.
+inline fn f32x4_greater(f32x4 a, f32x4 b) -> f32x4 {
+    F32X4_LANEWISE(a.v[i] > b.v[i] ? 1.0f : 0.0f);
+}
+inline fn f32x4_less(f32x4 a, f32x4 b) -> f32x4 {
+    F32X4_LANEWISE(a.v[i] < b.v[i] ? 1.0f : 0.0f);
+}
+
+inline fn f32x4_select(f32x4 mask, f32x4 a, f32x4 b) -> f32x4 {
+    F32X4_LANEWISE(mask.v[i] != 0.0f ? a.v[i] : b.v[i]);
+}
+
+inline fn f32x4_abs(f32x4 a) -> f32x4 { F32X4_LANEWISE(SDL_fabsf(a.v[i])); }
+inline fn f32x4_floor(f32x4 a) -> f32x4 { F32X4_LANEWISE(SDL_floorf(a.v[i])); }
+
+#undef F32X4_LANEWISE
+
+#endif
+
+inline fn operator+=(f32x4& a, f32x4 b) -> f32x4& {
+    a = a + b;
+    return a;
+}
+
+inline fn f32x4_clamp(f32x4 a, f32x4 lo, f32x4 hi) -> f32x4 {
+    return f32x4_min(f32x4_max(a, lo), hi);
+}
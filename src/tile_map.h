@@ -0,0 +1,167 @@
+#pragma once
+
+#include "core.h"
+
+// A sparse tile map. Tiles are grouped into fixed-size square chunks, and
+// chunks are found through an open-addressed hash keyed on chunk coordinates,
+// so a lookup is a hash and a short linear probe through one flat array.
+// Chunks are only allocated when a tile in them is first set, so memory grows
+// with the area that has something in it rather than with the world's extent.
+// Coordinates are unbounded in every direction, negative ones included.
+//
+// Chunks come from a pool that takes them from the arena one at a time, as
+// they're first needed. Neither the map nor its pool holds on to the arena
+// they came from: callers pass it in, since the map lives in persistent
+// storage and has to make sense to whichever build of the game is loaded.
+
+constexpr i32 MAP_TILE_SHIFT = 5;
+constexpr i32 MAP_TILE_PIXELS = 1 << MAP_TILE_SHIFT;
+constexpr i32 TILE_CHUNK_SHIFT = 4;
+constexpr i32 TILE_CHUNK_DIM = 1 << TILE_CHUNK_SHIFT;
+constexpr i32 TILE_CHUNK_MASK = TILE_CHUNK_DIM - 1;
+
+enum TileType : u8 {
+    TileEmpty,
+    TileWall,
+    TileFloor,
+};
+
+struct TileChunk {
+    i32 chunk_x;
+    i32 chunk_y;
+    u8 tiles[TILE_CHUNK_DIM * TILE_CHUNK_DIM];
+};
+
+// A null chunk marks an empty slot; chunks are never removed, so probes can
+// stop at the first one.
+struct TileChunkSlot {
+    i32 chunk_x;
+    i32 chunk_y;
+    TileChunk* chunk;
+};
+
+struct TileMap {
+    TileChunkSlot* slots;
+    u32 slot_count;
+    u32 chunk_count;
+    PoolAllocator<TileChunk> chunks;
+};
+
+// The map refuses new chunks past three quarters full, which keeps probes
+// short.
+static fn max_tile_chunks(u32 slot_count) -> u32 {
+    return slot_count / 4 * 3;
+}
+
+// slot_count is rounded up to a power of two.
+fn create_tile_map(FixedBufferAllocator* arena, u32 slot_count) -> TileMap {
+    slot_count = SDL_max(slot_count, 16u);
+    slot_count = 1u << (SDL_MostSignificantBitIndex32(slot_count - 1) + 1);
+
+    TileMap map = {};
+    map.slots = arena->alloc<TileChunkSlot>(slot_count);
+    if (map.slots) {
+        memset(map.slots, 0, sizeof(TileChunkSlot) * slot_count);
+        map.slot_count = slot_count;
+        map.chunks =
+            PoolAllocator<TileChunk>::create(max_tile_chunks(slot_count));
+    }
+
+    return map;
+}
+
+static fn tile_chunk_hash(i32 chunk_x, i32 chunk_y) -> u32 {
+    return ((u32)chunk_x * 73856093u) ^ ((u32)chunk_y * 19349663u);
+}
+
+// The slot holding the chunk, or the empty slot it would go in.
+static fn find_tile_chunk_slot(TileMap* map, i32 chunk_x, i32 chunk_y)
+    -> TileChunkSlot* {
+    u32 mask = map->slot_count - 1;
+    u32 index = tile_chunk_hash(chunk_x, chunk_y) & mask;
+
+    for (;;) {
+        TileChunkSlot* slot = &map->slots[index];
+        if (!slot->chunk ||
+            (slot->chunk_x == chunk_x && slot->chunk_y == chunk_y)) {
+            return slot;
+        }
+
+        index = (index + 1) & mask;
+    }
+}
+
+fn get_tile_chunk(TileMap* map, i32 chunk_x, i32 chunk_y) -> TileChunk* {
+    return find_tile_chunk_slot(map, chunk_x, chunk_y)->chunk;
+}
+
+fn get_or_create_tile_chunk(
+    TileMap* map,
+    FixedBufferAllocator* arena,
+    i32 chunk_x,
+    i32 chunk_y
+) -> TileChunk* {
+    TileChunkSlot* slot = find_tile_chunk_slot(map, chunk_x, chunk_y);
+    if (slot->chunk) {
+        return slot->chunk;
+    }
+
+    if (map->chunk_count >= max_tile_chunks(map->slot_count)) {
+        SDL_Log("Tile map of %u chunk slots is full", map->slot_count);
+        return nullptr;
+    }
+
+    TileChunk* chunk = map->chunks.alloc(arena);
+    if (!chunk) {
+        return nullptr;
+    }
+
+    chunk->chunk_x = chunk_x;
+    chunk->chunk_y = chunk_y;
+    memset(chunk->tiles, TileEmpty, sizeof(chunk->tiles));
+
+    *slot = TileChunkSlot{chunk_x, chunk_y, chunk};
+    map->chunk_count += 1;
+
+    return chunk;
+}
+
+fn get_tile(TileMap* map, i32 tile_x, i32 tile_y) -> u8 {
+    TileChunk* chunk = get_tile_chunk(
+        map,
+        tile_x >> TILE_CHUNK_SHIFT,
+        tile_y >> TILE_CHUNK_SHIFT
+    );
+    if (!chunk) {
+        return TileEmpty;
+    }
+
+    i32 local_x = tile_x & TILE_CHUNK_MASK;
+    i32 local_y = tile_y & TILE_CHUNK_MASK;
+    return chunk->tiles[local_y * TILE_CHUNK_DIM + local_x];
+}
+
+// Returns false if the chunk for the tile couldn't be created.
+fn set_tile(
+    TileMap* map,
+    FixedBufferAllocator* arena,
+    i32 tile_x,
+    i32 tile_y,
+    u8 value
+) -> bool {
+    TileChunk* chunk = get_or_create_tile_chunk(
+        map,
+        arena,
+        tile_x >> TILE_CHUNK_SHIFT,
+        tile_y >> TILE_CHUNK_SHIFT
+    );
+    if (!chunk) {
+        return false;
+    }
+
+    i32 local_x = tile_x & TILE_CHUNK_MASK;
+    i32 local_y = tile_y & TILE_CHUNK_MASK;
+    chunk->tiles[local_y * TILE_CHUNK_DIM + local_x] = value;
+
+    return true;
+}
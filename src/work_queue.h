@@ -0,0 +1,217 @@
+#pragma once
+
+#include "core.h"
+
+// Single-producer, multi-consumer ring of work entries. The producing thread
+// publishes entries by bumping next_entry_to_write; consumers claim them with
+// a compare-and-swap on next_entry_to_read, so no locks are taken on either
+// side. Idle workers sleep on the semaphore.
+//
+// Every thread that runs entries, the owning thread included, has a scratch
+// arena of its own. Each entry runs inside a temporary scope on it, so
+// callbacks can allocate from it freely and it's empty again afterwards.
+
+constexpr u32 WORK_QUEUE_CAPACITY = 8192;
+constexpr i32 MAX_WORKER_THREADS = 63;
+
+struct WorkQueue;
+typedef void WorkQueueCallback(
+    WorkQueue* queue,
+    FixedBufferAllocator* scratch,
+    void* data
+);
+
+struct WorkQueueThread {
+    WorkQueue* queue;
+    SDL_Thread* thread;
+    FixedBufferAllocator scratch;
+};
+
+struct WorkQueueEntry {
+    WorkQueueCallback* callback;
+    void* data;
+};
+
+struct WorkQueue {
+    SDL_AtomicInt completion_goal;
+    SDL_AtomicInt completion_count;
+
+    SDL_AtomicInt next_entry_to_write;
+    SDL_AtomicInt next_entry_to_read;
+
+    SDL_AtomicInt shutting_down;
+    SDL_Semaphore* semaphore;
+
+    i32 thread_count;
+    WorkQueueThread threads[MAX_WORKER_THREADS];
+    // The owning thread's, for the entries it runs in complete_all_work().
+    FixedBufferAllocator scratch;
+
+    WorkQueueEntry entries[WORK_QUEUE_CAPACITY];
+};
+
+// Only ever called from the thread that owns the queue.
+fn add_work_entry(WorkQueue* queue, WorkQueueCallback* callback, void* data)
+    -> void {
+    u32 next_entry_to_write = SDL_GetAtomicInt(&queue->next_entry_to_write);
+    u32 new_next_entry_to_write =
+        (next_entry_to_write + 1) % WORK_QUEUE_CAPACITY;
+    SDL_assert(
+        new_next_entry_to_write !=
+        (u32)SDL_GetAtomicInt(&queue->next_entry_to_read)
+    );
+
+    WorkQueueEntry* entry = &queue->entries[next_entry_to_write];
+    entry->callback = callback;
+    entry->data = data;
+
+    SDL_AddAtomicInt(&queue->completion_goal, 1);
+
+    SDL_MemoryBarrierRelease();
+    SDL_SetAtomicInt(&queue->next_entry_to_write, new_next_entry_to_write);
+    SDL_SignalSemaphore(queue->semaphore);
+}
+
+// Runs at most one entry. Returns false when the queue was empty.
+fn do_next_work_entry(WorkQueue* queue, FixedBufferAllocator* scratch)
+    -> bool {
+    u32 original_next_entry_to_read =
+        SDL_GetAtomicInt(&queue->next_entry_to_read);
+
+    if (original_next_entry_to_read ==
+        (u32)SDL_GetAtomicInt(&queue->next_entry_to_write)) {
+        return false;
+    }
+
+    u32 new_next_entry_to_read =
+        (original_next_entry_to_read + 1) % WORK_QUEUE_CAPACITY;
+
+    if (SDL_CompareAndSwapAtomicInt(
+            &queue->next_entry_to_read,
+            original_next_entry_to_read,
+            new_next_entry_to_read
+        )) {
+        SDL_MemoryBarrierAcquire();
+
+        WorkQueueEntry entry = queue->entries[original_next_entry_to_read];
+        TemporaryMemory temp = begin_temporary_memory(scratch);
+        entry.callback(queue, scratch, entry.data);
+        end_temporary_memory(temp);
+
+        SDL_AddAtomicInt(&queue->completion_count, 1);
+    }
+
+    return true;
+}
+
+// Completion barrier: the owning thread helps drain the queue until every
+// entry added so far has finished.
+fn complete_all_work(WorkQueue* queue) -> void {
+    while (SDL_GetAtomicInt(&queue->completion_goal) !=
+           SDL_GetAtomicInt(&queue->completion_count)) {
+        do_next_work_entry(queue, &queue->scratch);
+    }
+
+    SDL_SetAtomicInt(&queue->completion_goal, 0);
+    SDL_SetAtomicInt(&queue->completion_count, 0);
+}
+
+static fn work_queue_thread_proc(void* data) -> int {
+    WorkQueueThread* thread = (WorkQueueThread*)data;
+    WorkQueue* queue = thread->queue;
+
+    while (!SDL_GetAtomicInt(&queue->shutting_down)) {
+        if (!do_next_work_entry(queue, &thread->scratch)) {
+            SDL_WaitSemaphore(queue->semaphore);
+        }
+    }
+
+    return 0;
+}
+
+// The scratch arenas are reserved here, up front, so running entries never
+// touches the heap. Their pages are committed as entries first reach them.
+fn init_work_queue(
+    WorkQueue* queue,
+    i32 thread_count,
+    const char* name,
+    usize scratch_size = 0
+) -> bool {
+    SDL_SetAtomicInt(&queue->completion_goal, 0);
+    SDL_SetAtomicInt(&queue->completion_count, 0);
+    SDL_SetAtomicInt(&queue->next_entry_to_write, 0);
+    SDL_SetAtomicInt(&queue->next_entry_to_read, 0);
+    SDL_SetAtomicInt(&queue->shutting_down, 0);
+
+    queue->semaphore = SDL_CreateSemaphore(0);
+    if (!queue->semaphore) {
+        SDL_Log("Failed to create work queue semaphore: %s", SDL_GetError());
+        return false;
+    }
+
+    queue->thread_count = 0;
+    thread_count = SDL_clamp(thread_count, 0, MAX_WORKER_THREADS);
+
+    if (scratch_size) {
+        queue->scratch = FixedBufferAllocator::reserve(scratch_size);
+    }
+
+    for (i32 i = 0; i < thread_count; ++i) {
+        WorkQueueThread* thread = &queue->threads[i];
+        thread->queue = queue;
+        thread->scratch = scratch_size
+                              ? FixedBufferAllocator::reserve(scratch_size)
+                              : FixedBufferAllocator{};
+
+        thread->thread = SDL_CreateThread(work_queue_thread_proc, name, thread);
+        if (!thread->thread) {
+            SDL_Log("Failed to create worker thread: %s", SDL_GetError());
+            if (thread->scratch.memory) {
+                thread->scratch.destroy();
+            }
+            break;
+        }
+
+        queue->thread_count += 1;
+    }
+
+    return true;
+}
+
+fn shutdown_work_queue(WorkQueue* queue) -> void {
+    if (!queue->semaphore)
+        return;
+
+    SDL_SetAtomicInt(&queue->shutting_down, 1);
+
+    for (i32 i = 0; i < queue->thread_count; ++i) {
+        SDL_SignalSemaphore(queue->semaphore);
+    }
+
+    for (i32 i = 0; i < queue->thread_count; ++i) {
+        WorkQueueThread* thread = &queue->threads[i];
+        SDL_WaitThread(thread->thread, nullptr);
+
+        if (thread->scratch.memory) {
+            thread->scratch.destroy();
+        }
+    }
+
+    if (queue->scratch.memory) {
+        queue->scratch.destroy();
+    }
+
+    SDL_DestroySemaphore(queue->semaphore);
+    queue->semaphore = nullptr;
+    queue->thread_count = 0;
+}
+
+// The most any one thread's scratch has held at once.
+fn work_queue_scratch_high_water(WorkQueue* queue) -> usize {
+    usize high_water = queue->scratch.high_water;
+    for (i32 i = 0; i < queue->thread_count; ++i) {
+        high_water = SDL_max(high_water, queue->threads[i].scratch.high_water);
+    }
+
+    return high_water;
+}